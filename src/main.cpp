@@ -4,6 +4,15 @@
  *
  */
 
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
 #include <SFML/Graphics.hpp>
 #define VOLK_IMPLEMENTATION
 #include <volk/volk.h>
@@ -11,6 +20,22 @@
 #include <string>
 #include <iostream>
 #include <fstream>
+#include <filesystem>
+#include <format>
+#include <array>
+#include <future>
+#include <mutex>
+#include <thread>
+#include <chrono>
+#include <algorithm>
+#include <numeric>
+#include <string_view>
+#include <memory>
+#include <functional>
+#include <cmath>
+#include <deque>
+#include <atomic>
+#include <optional>
 #define VMA_IMPLEMENTATION
 #include <vma/vk_mem_alloc.h>
 #define GLM_FORCE_RADIANS
@@ -36,37 +61,80 @@ static inline void chk(bool result) {
 	}
 }
 
-const uint32_t maxFramesInFlight{ 2 };
+// Can be changed with --frames-in-flight
+uint32_t maxFramesInFlight{ 2 };
+const uint32_t maxSupportedFramesInFlight{ 4 };
 const VkSampleCountFlagBits sampleCount = VK_SAMPLE_COUNT_4_BIT;
 uint32_t imageIndex{ 0 };
 uint32_t frameIndex{ 0 };
 VkInstance instance{ VK_NULL_HANDLE };
+VkPhysicalDevice physicalDevice{ VK_NULL_HANDLE };
 VkDevice device{ VK_NULL_HANDLE };
 VkQueue queue{ VK_NULL_HANDLE };
+uint32_t queueFamily{ 0 };
+// Uploads go to a transfer-only queue family if the device has one, otherwise to the graphics queue
+uint32_t uploadQueueFamily{ 0 };
+VkQueue uploadQueue{ VK_NULL_HANDLE };
+VkCommandPool uploadCommandPool{ VK_NULL_HANDLE };
 VkSurfaceKHR surface{ VK_NULL_HANDLE };
 VkSwapchainKHR swapchain{ VK_NULL_HANDLE };
 VkCommandPool commandPool{ VK_NULL_HANDLE };
 VkPipeline pipeline{ VK_NULL_HANDLE };
 VkPipelineLayout pipelineLayout{ VK_NULL_HANDLE };
+VkPipelineCache pipelineCache{ VK_NULL_HANDLE };
 VkImage renderImage;
 VmaAllocation renderImageAllocation;
 VkImageView renderImageView;
 std::vector<VkImage> swapchainImages;
 std::vector<VkImageView> swapchainImageViews;
-std::vector<VkCommandBuffer> commandBuffers(maxFramesInFlight);
-std::vector<VkFence> fences(maxFramesInFlight);
-std::vector<VkSemaphore> presentSemaphores(maxFramesInFlight);
+// Only used in headless mode, where the swapchain images are replaced by images allocated by the application
+std::vector<VmaAllocation> offscreenImageAllocations;
+std::vector<VkCommandBuffer> commandBuffers;
+std::vector<VkSemaphore> presentSemaphores;
 std::vector<VkSemaphore> renderSemaphores;
+// Presents wait on the render semaphores outside of the frame timeline, so those of retired swapchains (and the swapchains) are kept until a present on the current swapchain is known to have finished
+struct RetiredPresentResources {
+	VkSwapchainKHR swapchain{ VK_NULL_HANDLE };
+	std::vector<VkSemaphore> renderSemaphores;
+};
+std::vector<RetiredPresentResources> retiredPresentResources;
+// If swapchains are recreated faster than their images are presented and acquired again, the oldest is freed after waiting for the queue instead
+const size_t maxRetiredSwapchains{ 2 };
+// Images of the current swapchain that have been presented, acquiring one of them again means its last present has finished
+std::vector<bool> presentedImages;
 VmaAllocator allocator{ VK_NULL_HANDLE };
+VkSemaphore uploadTimeline{ VK_NULL_HANDLE };
+uint64_t uploadTimelineValue{ 0 };
+// Every frame submission signals its frame number, per-frame resources of frame N can be reused once frame N - maxFramesInFlight has been reached
+// Uploads have their own timeline, as they complete out of order with the frames on a different queue
+VkSemaphore frameTimeline{ VK_NULL_HANDLE };
+uint64_t frameTimelineValue{ 0 };
+struct UploadCommandBuffer {
+	VkCommandBuffer commandBuffer{ VK_NULL_HANDLE };
+	uint64_t value{ 0 };
+};
+std::deque<UploadCommandBuffer> uploadCommandBuffers;
+// Objects that may still be in use by the GPU, destroyed once the frame timeline has reached the last frame that used them
+struct DeferredDeletion {
+	uint64_t frameValue{ 0 };
+	std::function<void()> destroy;
+};
+std::deque<DeferredDeletion> deletionQueue;
 VmaAllocation vBufferAllocation{ VK_NULL_HANDLE };
 VkBuffer vBuffer{ VK_NULL_HANDLE };
-struct UniformBuffers {
+// Per-object uniform data of all frames in flight, each frame fills its own region linearly and draws select their data with a dynamic offset
+struct UniformRing {
 	VmaAllocation allocation{ VK_NULL_HANDLE };
 	VkBuffer buffer{ VK_NULL_HANDLE };
 	VkDescriptorSet descriptorSet{ VK_NULL_HANDLE };
-	void* mapped{ nullptr };
+	char* mapped{ nullptr };
+	VkDeviceSize alignment{ 0 };
+	VkDeviceSize frameSize{ 0 };
+	// Start of the current frame's region and the next free byte in it
+	VkDeviceSize frameStart{ 0 };
+	VkDeviceSize head{ 0 };
 };
-std::vector<UniformBuffers> uniformBuffers(maxFramesInFlight);
+UniformRing uniformRing;
 VkDescriptorSetLayout descriptorSetLayout{ VK_NULL_HANDLE };
 VkDescriptorPool descriptorPool{ VK_NULL_HANDLE };
 struct Texture {
@@ -75,28 +143,1575 @@ struct Texture {
 	VkImageView view{ VK_NULL_HANDLE };
 	VkSampler sampler{ VK_NULL_HANDLE };
 	VkDescriptorSet descriptorSet{ VK_NULL_HANDLE };
+	// Upload timeline value that signals the upload is complete
+	uint64_t uploadValue{ 0 };
+	bool ready{ false };
+	// Records the queue family ownership acquire and anything that needs a graphics queue (mip generation), empty if nothing is left to do
+	std::function<void(VkCommandBuffer)> recordAcquire;
+	// Releases temporary upload objects, handed to the deletion queue with the frame that records recordAcquire (or the first one using the texture)
+	std::function<void()> cleanup;
 };
 Texture texture;
+// Sampled until the real texture has been streamed in
+Texture placeholderTexture;
+// Read-only memory mapping of a whole file
+struct MappedFile {
+	const char* data{ nullptr };
+	size_t size{ 0 };
+#if defined(_WIN32)
+	HANDLE file{ INVALID_HANDLE_VALUE };
+	HANDLE mapping{ nullptr };
+#endif
+	MappedFile(const std::filesystem::path& fileName) {
+#if defined(_WIN32)
+		file = CreateFileW(fileName.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+		LARGE_INTEGER fileSize{};
+		if ((file == INVALID_HANDLE_VALUE) || !GetFileSizeEx(file, &fileSize) || (fileSize.QuadPart == 0)) {
+			return;
+		}
+		mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		if (mapping) {
+			data = static_cast<const char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+			size = data ? static_cast<size_t>(fileSize.QuadPart) : 0;
+		}
+#else
+		const int fd{ open(fileName.c_str(), O_RDONLY) };
+		struct stat fileStat {};
+		if ((fd >= 0) && (fstat(fd, &fileStat) == 0) && (fileStat.st_size > 0)) {
+			void* ptr{ mmap(nullptr, fileStat.st_size, PROT_READ, MAP_PRIVATE, fd, 0) };
+			if (ptr != MAP_FAILED) {
+				madvise(ptr, fileStat.st_size, MADV_WILLNEED);
+				data = static_cast<const char*>(ptr);
+				size = static_cast<size_t>(fileStat.st_size);
+			}
+		}
+		if (fd >= 0) {
+			close(fd);
+		}
+#endif
+	}
+	~MappedFile() {
+#if defined(_WIN32)
+		if (data) {
+			UnmapViewOfFile(data);
+		}
+		if (mapping) {
+			CloseHandle(mapping);
+		}
+		if (file != INVALID_HANDLE_VALUE) {
+			CloseHandle(file);
+		}
+#else
+		if (data) {
+			munmap(const_cast<char*>(data), size);
+		}
+#endif
+	}
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+};
+// Texture data is read straight from the file mapping, no intermediate copy of the whole file is made
+struct TextureFile {
+	std::unique_ptr<MappedFile> file;
+	ddsktx_texture_info info{};
+};
 VkDescriptorSetLayout descriptorSetLayoutTex{ VK_NULL_HANDLE };
 Slang::ComPtr<slang::IGlobalSession> slangGlobalSession;
+std::mutex slangMutex;
 glm::vec3 rotation{ 0.0f };
 sf::Vector2i lastMousePos{};
+const std::filesystem::path cacheDir{ "cache" };
+const std::filesystem::path pipelineCacheFile{ cacheDir / "pipeline.bin" };
+const char* shaderProfile{ "spirv_1_6" };
+const auto shaderCompilerOptions{ std::to_array<slang::CompilerOptionEntry>({ { slang::CompilerOptionName::EmitSpirvDirectly, {slang::CompilerOptionValueKind::Int, 1} } }) };
+
+using Clock = std::chrono::steady_clock;
+const Clock::time_point processStart{ Clock::now() };
+const std::thread::id mainThreadId{ std::this_thread::get_id() };
+struct StartupPhase {
+	std::string name;
+	bool mainThread{ true };
+	double startMs{ 0.0 };
+	double durationMs{ 0.0 };
+};
+std::mutex startupPhasesMutex;
+std::vector<StartupPhase> startupPhases;
+struct Options {
+	bool startupReport{ false };
+	std::string startupReportFile;
+	uint32_t startupRepeat{ 1 };
+	std::string startupRunFile;
+	// 0 = not set on the command line
+	uint32_t framesInFlight{ 0 };
+	bool latencyReport{ false };
+	std::string latencyReportFile;
+	uint32_t latencyFrames{ 500 };
+	std::string latencyRunFile;
+	// In order of preference
+	std::vector<VkPresentModeKHR> presentModes{ VK_PRESENT_MODE_FIFO_KHR };
+	bool fpsReport{ false };
+	std::string fpsReportFile;
+	bool framePacing{ false };
+	bool lateLatch{ false };
+	// Passes the matrix as a push constant instead of through the per-frame uniform buffers
+	bool pushConstants{ false };
+	uint32_t objectCount{ 1 };
+	// Renders a fixed number of frames into offscreen images, without a window or any WSI
+	bool headless{ false };
+	// 0 = not given, 300 or as many as the benchmark and latency measurements need
+	uint64_t headlessFrames{ 0 };
+	// Number of frames measured after the warmup, 0 = no benchmark
+	uint32_t benchmarkFrames{ 0 };
+	bool gpuTimes{ false };
+	std::string gpuTimesFile;
+	bool drawStats{ false };
+	std::string drawStatsFile;
+	// Chrome trace of CPU zones and GPU passes, empty = no tracing
+	std::string traceFile;
+} options;
+
+const auto presentModeNames{ std::to_array<std::pair<std::string_view, VkPresentModeKHR>>({ { "fifo", VK_PRESENT_MODE_FIFO_KHR }, { "fifo_relaxed", VK_PRESENT_MODE_FIFO_RELAXED_KHR }, { "mailbox", VK_PRESENT_MODE_MAILBOX_KHR }, { "immediate", VK_PRESENT_MODE_IMMEDIATE_KHR } }) };
+
+static std::string_view presentModeName(VkPresentModeKHR presentMode) {
+	for (const auto& [name, mode] : presentModeNames) {
+		if (mode == presentMode) {
+			return name;
+		}
+	}
+	return "unknown";
+}
+
+// Comma separated list, e.g. "mailbox,immediate,fifo"
+static std::vector<VkPresentModeKHR> parsePresentModes(std::string_view list) {
+	std::vector<VkPresentModeKHR> presentModes;
+	while (!list.empty()) {
+		const size_t end{ std::min(list.find(','), list.size()) };
+		const std::string_view name{ list.substr(0, end) };
+		auto it{ std::find_if(presentModeNames.begin(), presentModeNames.end(), [name](const auto& entry) { return entry.first == name; }) };
+		if (it == presentModeNames.end()) {
+			std::cerr << "Unknown present mode " << name << "\n";
+			exit(-1);
+		}
+		presentModes.push_back(it->second);
+		list.remove_prefix(std::min(end + 1, list.size()));
+	}
+	return presentModes;
+}
+
+static double msBetween(Clock::time_point start, Clock::time_point end) {
+	return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+// Zones for --trace, written as a Chrome trace that can be opened in Perfetto or chrome://tracing
+struct TraceEvent {
+	std::string name;
+	std::string_view category;
+	// 'X' for zones, 'i' for zero length events
+	char phase{ 'X' };
+	uint32_t tid{ 0 };
+	double startUs{ 0.0 };
+	double durationUs{ 0.0 };
+};
+struct Tracer {
+	std::mutex mutex;
+	std::vector<TraceEvent> events;
+	// CPU threads are numbered in the order they first record something
+	std::vector<std::thread::id> threads;
+	std::string gpuClock{ "none" };
+} tracer;
+const uint32_t traceGpuTid{ 1000 };
+// Keeps long sessions from growing the trace without bounds
+const size_t traceMaxEvents{ 2'000'000 };
+
+// Thread-safe, GPU zones are put on their own track instead of the calling thread's
+static void traceAdd(std::string_view name, std::string_view category, Clock::time_point start, Clock::time_point end, bool gpu = false) {
+	if (options.traceFile.empty()) {
+		return;
+	}
+	std::lock_guard<std::mutex> lock(tracer.mutex);
+	if (tracer.events.size() >= traceMaxEvents) {
+		return;
+	}
+	uint32_t tid{ traceGpuTid };
+	if (!gpu) {
+		const auto it{ std::find(tracer.threads.begin(), tracer.threads.end(), std::this_thread::get_id()) };
+		tid = (uint32_t)std::distance(tracer.threads.begin(), it);
+		if (it == tracer.threads.end()) {
+			tracer.threads.push_back(std::this_thread::get_id());
+		}
+	}
+	const auto usSinceStart = [](Clock::time_point time) { return std::chrono::duration<double, std::micro>(time - processStart).count(); };
+	tracer.events.push_back({ .name = std::string(name), .category = category, .phase = (start == end) ? 'i' : 'X', .tid = tid, .startUs = usSinceStart(start), .durationUs = usSinceStart(end) - usSinceStart(start) });
+}
+
+static void writeTrace(const std::filesystem::path& path) {
+	std::ofstream file(path);
+	file << "{ \"displayTimeUnit\": \"ms\", \"otherData\": { \"gpu_clock\": \"" << tracer.gpuClock << "\" }, \"traceEvents\": [\n";
+	for (uint32_t tid = 0; tid < tracer.threads.size(); tid++) {
+		const std::string threadName{ (tracer.threads[tid] == mainThreadId) ? std::string("Main thread") : std::format("Worker thread {}", tid) };
+		file << "{ \"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 0, \"tid\": " << tid << ", \"args\": { \"name\": \"" << threadName << "\" } },\n";
+	}
+	file << "{ \"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 0, \"tid\": " << traceGpuTid << ", \"args\": { \"name\": \"GPU (graphics queue)\" } }";
+	for (const auto& event : tracer.events) {
+		file << ",\n{ \"name\": \"" << event.name << "\", \"cat\": \"" << event.category << "\", \"ph\": \"" << event.phase << "\", \"pid\": 0, \"tid\": " << event.tid << ", \"ts\": " << event.startUs;
+		if (event.phase == 'X') {
+			file << ", \"dur\": " << event.durationUs;
+		} else {
+			file << ", \"s\": \"t\"";
+		}
+		file << " }";
+	}
+	file << "\n] }\n";
+}
+
+// Thread-safe, so it can also be used for the startup work done on worker threads
+static void recordStartupPhase(const char* name, Clock::time_point start) {
+	const Clock::time_point end{ Clock::now() };
+	std::lock_guard<std::mutex> lock(startupPhasesMutex);
+	startupPhases.push_back({ .name = name, .mainThread = std::this_thread::get_id() == mainThreadId, .startMs = msBetween(processStart, start), .durationMs = msBetween(start, end) });
+	// Milestones measured from process start would overlap everything else, so they're traced as points in time
+	traceAdd(name, "startup", (start == processStart) ? end : start, end);
+}
+
+struct SampleStats {
+	double min{ 0.0 };
+	double mean{ 0.0 };
+	double p50{ 0.0 };
+	double p95{ 0.0 };
+	double p99{ 0.0 };
+	double max{ 0.0 };
+};
+
+static SampleStats computeStats(std::vector<double> samples) {
+	if (samples.empty()) {
+		return {};
+	}
+	std::sort(samples.begin(), samples.end());
+	auto percentile = [&samples](double p) { return samples[std::min(samples.size() - 1, (size_t)(p * (samples.size() - 1) + 0.5))]; };
+	return { .min = samples.front(), .mean = std::accumulate(samples.begin(), samples.end(), 0.0) / samples.size(), .p50 = percentile(0.5), .p95 = percentile(0.95), .p99 = percentile(0.99), .max = samples.back() };
+}
+
+static void writeStatsJson(std::ostream& out, const SampleStats& stats) {
+	out << "{ \"min\": " << stats.min << ", \"mean\": " << stats.mean << ", \"p50\": " << stats.p50 << ", \"p95\": " << stats.p95 << ", \"p99\": " << stats.p99 << ", \"max\": " << stats.max << " }";
+}
+
+// One entry per run, phases are matched across runs by name
+static void writeStartupReport(const std::vector<std::vector<StartupPhase>>& runs) {
+	std::ofstream file;
+	if (!options.startupReportFile.empty()) {
+		file.open(options.startupReportFile);
+	}
+	std::ostream& out{ file.is_open() ? file : std::cout };
+	std::vector<std::string> names;
+	for (const auto& run : runs) {
+		for (const auto& phase : run) {
+			if (std::find(names.begin(), names.end(), phase.name) == names.end()) {
+				names.push_back(phase.name);
+			}
+		}
+	}
+	out << "{\n\t\"runs\": " << runs.size() << ",\n\t\"phases\": [\n";
+	for (size_t i = 0; i < names.size(); i++) {
+		std::vector<double> starts, durations;
+		bool mainThread{ true };
+		for (const auto& run : runs) {
+			for (const auto& phase : run) {
+				if (phase.name == names[i]) {
+					starts.push_back(phase.startMs);
+					durations.push_back(phase.durationMs);
+					mainThread = phase.mainThread;
+				}
+			}
+		}
+		out << "\t\t{ \"name\": \"" << names[i] << "\", \"thread\": \"" << (mainThread ? "main" : "worker") << "\", \"start_ms\": ";
+		writeStatsJson(out, computeStats(starts));
+		out << ", \"duration_ms\": ";
+		writeStatsJson(out, computeStats(durations));
+		out << " }" << (i + 1 < names.size() ? "," : "") << "\n";
+	}
+	out << "\t]\n}\n";
+}
+
+// Command line for running this executable again, without the given options (and their values)
+static std::string childCommand(const char* executable, int argc, char* argv[], std::initializer_list<std::string_view> skipOptions) {
+	std::string command{ "\"" + std::string(executable) + "\"" };
+	for (int j = 1; j < argc; j++) {
+		const std::string_view arg{ argv[j] };
+		if (std::find(skipOptions.begin(), skipOptions.end(), arg) != skipOptions.end()) {
+			// Skip the option and its value
+			if (j + 1 < argc && argv[j + 1][0] != '-') {
+				j++;
+			}
+			continue;
+		}
+		command += " \"" + std::string(arg) + "\"";
+	}
+	return command;
+}
+
+static bool runChild(std::string command) {
+#if defined(_WIN32)
+	command = "\"" + command + "\"";
+#endif
+	return std::system(command.c_str()) == 0;
+}
+
+// Startup is measured across separate processes so every run is a real cold start of this executable
+static int runStartupRepetitions(const char* executable, int argc, char* argv[]) {
+	std::vector<std::vector<StartupPhase>> runs;
+	const std::filesystem::path runFile{ std::filesystem::temp_directory_path() / "modernvktriangle_startup.txt" };
+	for (uint32_t i = 0; i < options.startupRepeat; i++) {
+		const std::string command{ childCommand(executable, argc, argv, { "--startup-repeat", "--startup-report" }) + " --startup-run \"" + runFile.string() + "\"" };
+		std::error_code ec;
+		std::filesystem::remove(runFile, ec);
+		if (!runChild(command)) {
+			std::cerr << "Startup run " << i << " failed\n";
+			return -1;
+		}
+		std::ifstream file(runFile);
+		std::vector<StartupPhase> run;
+		StartupPhase phase;
+		while (file >> phase.name >> phase.mainThread >> phase.startMs >> phase.durationMs) {
+			run.push_back(phase);
+		}
+		runs.push_back(run);
+	}
+	writeStartupReport(runs);
+	return 0;
+}
+
+// Frame throughput and latency from sampling input to the GPU having finished the frame that used it
+// A separate thread waits on the frame timeline, so completion is timestamped independently of what the render loop is blocked on
+struct LatencyTracker {
+	struct PendingFrame {
+		uint64_t value{ 0 };
+		Clock::time_point inputTime;
+	};
+	std::thread thread;
+	std::atomic<bool> stop{ false };
+	std::mutex mutex;
+	std::deque<PendingFrame> pending;
+	std::vector<double> latencies;
+	// Only accessed by the render loop
+	std::vector<double> frameTimes;
+} latencyTracker;
+// Frames rendered before measuring, so startup and texture streaming don't skew the results
+const uint32_t latencyWarmupFrames{ 60 };
+
+static void latencyTrackerRun(VkSemaphore timeline) {
+	uint64_t value{ 1 };
+	while (!latencyTracker.stop) {
+		VkSemaphoreWaitInfo waitInfo{ .sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO, .semaphoreCount = 1, .pSemaphores = &timeline, .pValues = &value };
+		// Times out regularly so the thread can be stopped
+		if (vkWaitSemaphores(device, &waitInfo, 10'000'000) != VK_SUCCESS) {
+			continue;
+		}
+		const Clock::time_point now{ Clock::now() };
+		chk(vkGetSemaphoreCounterValue(device, timeline, &value));
+		std::lock_guard<std::mutex> lock(latencyTracker.mutex);
+		while (!latencyTracker.pending.empty() && (latencyTracker.pending.front().value <= value)) {
+			latencyTracker.latencies.push_back(msBetween(latencyTracker.pending.front().inputTime, now));
+			latencyTracker.pending.pop_front();
+		}
+		value++;
+	}
+}
+
+static void writeLatencyJson(std::ostream& out) {
+	const auto& frameTimes{ latencyTracker.frameTimes };
+	const double totalMs{ std::accumulate(frameTimes.begin(), frameTimes.end(), 0.0) };
+	out << "{ \"frames_in_flight\": " << maxFramesInFlight << ", \"frames\": " << frameTimes.size() << ", \"fps\": " << (totalMs > 0.0 ? frameTimes.size() * 1000.0 / totalMs : 0.0) << ", \"frame_time_ms\": ";
+	writeStatsJson(out, computeStats(frameTimes));
+	out << ", \"latency_ms\": ";
+	writeStatsJson(out, computeStats(latencyTracker.latencies));
+	out << " }";
+}
+
+// Measures every frames in flight setting in a separate process, so they all start from the same state
+static int runLatencySweep(const char* executable, int argc, char* argv[]) {
+	const std::filesystem::path runFile{ std::filesystem::temp_directory_path() / "modernvktriangle_latency.txt" };
+	std::vector<std::string> results;
+	for (uint32_t framesInFlight = 1; framesInFlight <= maxSupportedFramesInFlight; framesInFlight++) {
+		const std::string command{ childCommand(executable, argc, argv, { "--latency-report" }) + " --latency-report --frames-in-flight " + std::to_string(framesInFlight) + " --latency-run \"" + runFile.string() + "\"" };
+		std::error_code ec;
+		std::filesystem::remove(runFile, ec);
+		if (!runChild(command)) {
+			std::cerr << "Latency run with " << framesInFlight << " frames in flight failed\n";
+			return -1;
+		}
+		std::ifstream file(runFile);
+		std::string result;
+		std::getline(file, result);
+		results.push_back(result);
+	}
+	std::ofstream file;
+	if (!options.latencyReportFile.empty()) {
+		file.open(options.latencyReportFile);
+	}
+	std::ostream& out{ file.is_open() ? file : std::cout };
+	out << "{\n\t\"settings\": [\n";
+	for (size_t i = 0; i < results.size(); i++) {
+		out << "\t\t" << results[i] << (i + 1 < results.size() ? "," : "") << "\n";
+	}
+	out << "\t]\n}\n";
+	return 0;
+}
+
+// CPU time of the render loop phases, accumulated per frame and collected for --benchmark
+enum BenchmarkPhase { BenchmarkWait, BenchmarkAcquire, BenchmarkEvents, BenchmarkUniforms, BenchmarkRecord, BenchmarkSubmit, BenchmarkPresent, BenchmarkPhaseCount };
+const auto benchmarkPhaseNames{ std::to_array<std::string_view>({ "wait", "acquire", "events", "uniforms", "record", "submit", "present" }) };
+struct FrameBenchmark {
+	std::array<double, BenchmarkPhaseCount> currentFrame{};
+	std::array<std::vector<double>, BenchmarkPhaseCount> phaseTimes;
+	std::vector<double> frameTimes;
+} frameBenchmark;
+const uint32_t benchmarkWarmupFrames{ 60 };
+
+// Ends a render loop phase, its time goes into the benchmark and the trace
+static void benchmarkPhase(BenchmarkPhase phase, Clock::time_point start) {
+	const Clock::time_point end{ Clock::now() };
+	frameBenchmark.currentFrame[phase] += msBetween(start, end);
+	traceAdd(benchmarkPhaseNames[phase], "frame", start, end);
+}
+
+// GPU timestamps written around the passes of every frame, read back without waiting once the frame timeline says the frame has finished
+enum GpuPass { GpuPassPreBarriers, GpuPassDraw, GpuPassResolve, GpuPassPostBarriers, GpuPassFrame, GpuPassCount };
+const auto gpuPassNames{ std::to_array<std::string_view>({ "pre_barriers", "draw", "resolve", "post_barriers", "frame" }) };
+// Frame start, rendering start, draws done, resolve done, frame end
+const uint32_t gpuTimestampsPerFrame{ 5 };
+// Statistics cover this many of the most recent frames
+const size_t gpuTimeWindow{ 240 };
+#if defined(_WIN32)
+const VkTimeDomainEXT hostTimeDomain{ VK_TIME_DOMAIN_QUERY_PERFORMANCE_COUNTER_EXT };
+#else
+const VkTimeDomainEXT hostTimeDomain{ VK_TIME_DOMAIN_CLOCK_MONOTONIC_EXT };
+#endif
+struct GpuTimer {
+	VkQueryPool queryPool{ VK_NULL_HANDLE };
+	double timestampPeriod{ 0.0 };
+	uint64_t validMask{ 0 };
+	// Per frame in flight, the frame whose timestamps haven't been read yet (value 0 = none) and when recording finished
+	struct PendingFrame {
+		uint64_t value{ 0 };
+		Clock::time_point recordTime{};
+	};
+	std::vector<PendingFrame> pending;
+	std::array<std::deque<double>, GpuPassCount> passTimes;
+	// A GPU timestamp and the CPU time it corresponds to, used to put GPU zones on the CPU timeline of the trace
+	bool calibratedTimestamps{ false };
+	uint64_t calibrationTicks{ 0 };
+	Clock::time_point calibrationTime{};
+} gpuTimer;
+
+// The steady clock uses the same source as the host time domain
+static Clock::time_point hostTimestampToClock(uint64_t value) {
+#if defined(_WIN32)
+	LARGE_INTEGER frequency{};
+	QueryPerformanceFrequency(&frequency);
+	const uint64_t ticksPerSecond{ (uint64_t)frequency.QuadPart };
+	const std::chrono::nanoseconds time{ (value / ticksPerSecond) * 1'000'000'000 + (value % ticksPerSecond) * 1'000'000'000 / ticksPerSecond };
+#else
+	const std::chrono::nanoseconds time{ value };
+#endif
+	return Clock::time_point(std::chrono::duration_cast<Clock::duration>(time));
+}
+
+static void gpuTimerCalibrate() {
+	const VkCalibratedTimestampInfoEXT timestampInfos[2]{
+		{ .sType = VK_STRUCTURE_TYPE_CALIBRATED_TIMESTAMP_INFO_EXT, .timeDomain = VK_TIME_DOMAIN_DEVICE_EXT },
+		{ .sType = VK_STRUCTURE_TYPE_CALIBRATED_TIMESTAMP_INFO_EXT, .timeDomain = hostTimeDomain }
+	};
+	uint64_t timestamps[2]{};
+	uint64_t maxDeviation{ 0 };
+	chk(vkGetCalibratedTimestampsEXT(device, 2, timestampInfos, timestamps, &maxDeviation));
+	gpuTimer.calibrationTicks = timestamps[0];
+	gpuTimer.calibrationTime = hostTimestampToClock(timestamps[1]);
+}
+
+// Timestamps may be before or after the calibration point, and only have timestampValidBits
+static Clock::time_point gpuTimestampToClock(uint64_t ticks) {
+	int64_t delta{ (int64_t)((ticks - gpuTimer.calibrationTicks) & gpuTimer.validMask) };
+	if ((gpuTimer.validMask != UINT64_MAX) && ((uint64_t)delta > gpuTimer.validMask / 2)) {
+		delta -= (int64_t)gpuTimer.validMask + 1;
+	}
+	return gpuTimer.calibrationTime + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double, std::nano>(delta * gpuTimer.timestampPeriod));
+}
+
+static void gpuTimerCreate(float timestampPeriod, uint32_t validBits, bool calibratedTimestamps) {
+	VkQueryPoolCreateInfo queryPoolCI{ .sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO, .queryType = VK_QUERY_TYPE_TIMESTAMP, .queryCount = gpuTimestampsPerFrame * maxFramesInFlight };
+	chk(vkCreateQueryPool(device, &queryPoolCI, nullptr, &gpuTimer.queryPool));
+	gpuTimer.timestampPeriod = timestampPeriod;
+	gpuTimer.validMask = (validBits >= 64) ? UINT64_MAX : ((1ull << validBits) - 1);
+	gpuTimer.pending.resize(maxFramesInFlight);
+	gpuTimer.calibratedTimestamps = calibratedTimestamps;
+	tracer.gpuClock = calibratedTimestamps ? "calibrated" : "estimated";
+}
+
+static void gpuTimerWrite(VkCommandBuffer cb, VkPipelineStageFlagBits stage, uint32_t timestamp) {
+	vkCmdWriteTimestamp(cb, stage, gpuTimer.queryPool, frameIndex * gpuTimestampsPerFrame + timestamp);
+}
+
+// Called once the frame that last used the slot has finished, results that still aren't available are dropped instead of waited for
+static void gpuTimerCollect(uint32_t frame) {
+	const GpuTimer::PendingFrame pending{ gpuTimer.pending[frame] };
+	if (pending.value == 0) {
+		return;
+	}
+	gpuTimer.pending[frame] = {};
+	// Pairs of timestamp and availability
+	std::array<uint64_t, gpuTimestampsPerFrame * 2> results{};
+	const VkResult result{ vkGetQueryPoolResults(device, gpuTimer.queryPool, frame * gpuTimestampsPerFrame, gpuTimestampsPerFrame, sizeof(results), results.data(), sizeof(uint64_t) * 2, VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WITH_AVAILABILITY_BIT) };
+	if (result == VK_NOT_READY) {
+		return;
+	}
+	chk(result);
+	auto msBetweenTimestamps = [&results](uint32_t start, uint32_t end) { return ((results[end * 2] - results[start * 2]) & gpuTimer.validMask) * gpuTimer.timestampPeriod / 1'000'000.0; };
+	for (uint32_t pass = 0; pass < GpuPassCount; pass++) {
+		auto& times{ gpuTimer.passTimes[pass] };
+		times.push_back((pass == GpuPassFrame) ? msBetweenTimestamps(0, gpuTimestampsPerFrame - 1) : msBetweenTimestamps(pass, pass + 1));
+		if (times.size() > gpuTimeWindow) {
+			times.pop_front();
+		}
+	}
+	if (!options.traceFile.empty()) {
+		// Calibrated right away, so clock drift doesn't build up over long traces. Without calibrated timestamps the first frame is assumed to start when recording finished
+		if (gpuTimer.calibratedTimestamps) {
+			gpuTimerCalibrate();
+		} else if (gpuTimer.calibrationTime == Clock::time_point{}) {
+			gpuTimer.calibrationTicks = results[0];
+			gpuTimer.calibrationTime = pending.recordTime;
+		}
+		auto timestampTime = [&results](uint32_t timestamp) { return gpuTimestampToClock(results[timestamp * 2]); };
+		traceAdd(std::format("frame {}", pending.value), "gpu", timestampTime(0), timestampTime(gpuTimestampsPerFrame - 1), true);
+		for (uint32_t pass = 0; pass < GpuPassFrame; pass++) {
+			traceAdd(gpuPassNames[pass], "gpu", timestampTime(pass), timestampTime(pass + 1), true);
+		}
+	}
+}
+
+static void writeGpuTimesJson(std::ostream& out) {
+	out << "{ \"frames\": " << gpuTimer.passTimes[GpuPassFrame].size();
+	for (uint32_t pass = 0; pass < GpuPassCount; pass++) {
+		out << ", \"" << gpuPassNames[pass] << "_ms\": ";
+		writeStatsJson(out, computeStats(std::vector<double>(gpuTimer.passTimes[pass].begin(), gpuTimer.passTimes[pass].end())));
+	}
+	out << " }";
+}
+
+// Pipeline statistics and samples passed of the draws of every frame, read back like the timestamps
+enum DrawStat { DrawStatVertexInvocations, DrawStatClippingInvocations, DrawStatClippingPrimitives, DrawStatFragmentInvocations, DrawStatSamplesPassed, DrawStatFragmentsPerPixel, DrawStatCount };
+const auto drawStatNames{ std::to_array<std::string_view>({ "vertex_invocations", "clipping_invocations", "clipping_primitives", "fragment_invocations", "samples_passed", "fragment_invocations_per_pixel" }) };
+// Results are returned in the order of the bits
+const VkQueryPipelineStatisticFlags drawStatFlags{ VK_QUERY_PIPELINE_STATISTIC_VERTEX_SHADER_INVOCATIONS_BIT | VK_QUERY_PIPELINE_STATISTIC_CLIPPING_INVOCATIONS_BIT | VK_QUERY_PIPELINE_STATISTIC_CLIPPING_PRIMITIVES_BIT | VK_QUERY_PIPELINE_STATISTIC_FRAGMENT_SHADER_INVOCATIONS_BIT };
+const uint32_t drawStatPipelineCount{ 4 };
+struct DrawStats {
+	VkQueryPool statisticsPool{ VK_NULL_HANDLE };
+	VkQueryPool occlusionPool{ VK_NULL_HANDLE };
+	VkQueryControlFlags occlusionFlags{ 0 };
+	// Per frame in flight, the number of pixels rendered by the frame whose queries haven't been read yet (0 = none)
+	std::vector<uint64_t> pendingPixels;
+	std::array<std::deque<double>, DrawStatCount> frames;
+} drawStats;
+
+static void drawStatsCreate(bool preciseOcclusion) {
+	VkQueryPoolCreateInfo queryPoolCI{ .sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO, .queryType = VK_QUERY_TYPE_PIPELINE_STATISTICS, .queryCount = maxFramesInFlight, .pipelineStatistics = drawStatFlags };
+	chk(vkCreateQueryPool(device, &queryPoolCI, nullptr, &drawStats.statisticsPool));
+	queryPoolCI.queryType = VK_QUERY_TYPE_OCCLUSION;
+	queryPoolCI.pipelineStatistics = 0;
+	chk(vkCreateQueryPool(device, &queryPoolCI, nullptr, &drawStats.occlusionPool));
+	// Without precise occlusion queries the count is only guaranteed to be non-zero if any sample passed
+	drawStats.occlusionFlags = preciseOcclusion ? VK_QUERY_CONTROL_PRECISE_BIT : 0;
+	drawStats.pendingPixels.resize(maxFramesInFlight);
+}
+
+static void drawStatsCollect(uint32_t frame) {
+	const uint64_t pixels{ drawStats.pendingPixels[frame] };
+	if (pixels == 0) {
+		return;
+	}
+	drawStats.pendingPixels[frame] = 0;
+	// Counters followed by availability
+	std::array<uint64_t, drawStatPipelineCount + 1> statistics{};
+	std::array<uint64_t, 2> occlusion{};
+	const VkQueryResultFlags resultFlags{ VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WITH_AVAILABILITY_BIT };
+	const VkResult statisticsResult{ vkGetQueryPoolResults(device, drawStats.statisticsPool, frame, 1, sizeof(statistics), statistics.data(), sizeof(statistics), resultFlags) };
+	const VkResult occlusionResult{ vkGetQueryPoolResults(device, drawStats.occlusionPool, frame, 1, sizeof(occlusion), occlusion.data(), sizeof(occlusion), resultFlags) };
+	if ((statisticsResult == VK_NOT_READY) || (occlusionResult == VK_NOT_READY)) {
+		return;
+	}
+	chk(statisticsResult);
+	chk(occlusionResult);
+	std::array<double, DrawStatCount> values{};
+	for (uint32_t i = 0; i < drawStatPipelineCount; i++) {
+		values[i] = (double)statistics[i];
+	}
+	values[DrawStatSamplesPassed] = (double)occlusion[0];
+	values[DrawStatFragmentsPerPixel] = values[DrawStatFragmentInvocations] / (double)pixels;
+	for (uint32_t i = 0; i < DrawStatCount; i++) {
+		drawStats.frames[i].push_back(values[i]);
+		if (drawStats.frames[i].size() > gpuTimeWindow) {
+			drawStats.frames[i].pop_front();
+		}
+	}
+}
+
+static void writeDrawStatsJson(std::ostream& out, VkExtent2D extent) {
+	out << "{ \"extent\": [" << extent.width << ", " << extent.height << "], \"samples\": " << sampleCount << ", \"objects\": " << options.objectCount << ", \"precise_occlusion\": " << (drawStats.occlusionFlags != 0 ? "true" : "false") << ", \"frames\": " << drawStats.frames[0].size();
+	for (uint32_t stat = 0; stat < DrawStatCount; stat++) {
+		out << ", \"" << drawStatNames[stat] << "\": ";
+		writeStatsJson(out, computeStats(std::vector<double>(drawStats.frames[stat].begin(), drawStats.frames[stat].end())));
+	}
+	out << " }";
+}
+
+static void writeBenchmarkJson(std::ostream& out) {
+	out << "{ \"frames_in_flight\": " << maxFramesInFlight << ", \"objects\": " << options.objectCount << ", \"frames\": " << frameBenchmark.frameTimes.size() << ", \"frame_time_ms\": ";
+	writeStatsJson(out, computeStats(frameBenchmark.frameTimes));
+	out << ", \"phases_ms\": { ";
+	for (uint32_t i = 0; i < BenchmarkPhaseCount; i++) {
+		out << (i > 0 ? ", " : "") << "\"" << benchmarkPhaseNames[i] << "\": ";
+		writeStatsJson(out, computeStats(frameBenchmark.phaseTimes[i]));
+	}
+	out << " } }";
+}
+
+// First mode from the preference list that the surface supports, FIFO is always supported and used as the fallback
+static VkPresentModeKHR selectPresentMode(const std::vector<VkPresentModeKHR>& preferredModes) {
+	uint32_t modeCount{ 0 };
+	chk(vkGetPhysicalDeviceSurfacePresentModesKHR(physicalDevice, surface, &modeCount, nullptr));
+	std::vector<VkPresentModeKHR> supportedModes(modeCount);
+	chk(vkGetPhysicalDeviceSurfacePresentModesKHR(physicalDevice, surface, &modeCount, supportedModes.data()));
+	for (auto mode : preferredModes) {
+		if (std::find(supportedModes.begin(), supportedModes.end(), mode) != supportedModes.end()) {
+			return mode;
+		}
+	}
+	return VK_PRESENT_MODE_FIFO_KHR;
+}
+
+// Uncapped modes get an extra image so rendering never has to wait for one, MAILBOX needs at least three to replace queued images
+static uint32_t selectImageCount(const VkSurfaceCapabilitiesKHR& surfaceCaps, VkPresentModeKHR presentMode) {
+	uint32_t imageCount{ std::max(surfaceCaps.minImageCount, 2u) };
+	if (presentMode == VK_PRESENT_MODE_MAILBOX_KHR) {
+		imageCount = std::max(surfaceCaps.minImageCount + 1, 3u);
+	}
+	if (presentMode == VK_PRESENT_MODE_IMMEDIATE_KHR) {
+		imageCount = surfaceCaps.minImageCount + 1;
+	}
+	if (surfaceCaps.maxImageCount > 0) {
+		imageCount = std::min(imageCount, surfaceCaps.maxImageCount);
+	}
+	return imageCount;
+}
+
+static std::vector<char> readFile(const std::filesystem::path& fileName) {
+	std::ifstream file(fileName, std::ios::binary | std::ios::ate);
+	if (!file.is_open()) {
+		return {};
+	}
+	std::vector<char> data(static_cast<size_t>(file.tellg()));
+	file.seekg(std::ios::beg);
+	file.read(data.data(), data.size());
+	return file ? data : std::vector<char>{};
+}
+
+// Writes to a temporary file first and then renames it, so an interrupted write never leaves a truncated file behind
+static void writeFileAtomic(const std::filesystem::path& fileName, const void* data, size_t size) {
+	std::error_code ec;
+	std::filesystem::create_directories(fileName.parent_path(), ec);
+	auto tmpFile{ fileName };
+	tmpFile += ".tmp";
+	{
+		std::ofstream file(tmpFile, std::ios::binary | std::ios::trunc);
+		file.write(static_cast<const char*>(data), size);
+		if (!file) {
+			return;
+		}
+	}
+	std::filesystem::rename(tmpFile, fileName, ec);
+	if (ec) {
+		std::filesystem::remove(tmpFile, ec);
+	}
+}
+
+// FNV-1a
+static uint64_t hashData(const void* data, size_t size, uint64_t hash = 14695981039346656037ull) {
+	for (size_t i = 0; i < size; i++) {
+		hash = (hash ^ static_cast<const uint8_t*>(data)[i]) * 1099511628211ull;
+	}
+	return hash;
+}
+
+static uint64_t hashString(const char* str, uint64_t hash) {
+	return hashData(str, str ? strlen(str) + 1 : 0, hash);
+}
+
+// Returns the stored pipeline cache blob, or nothing if it's missing or was created by a different driver/device
+static std::vector<char> loadPipelineCacheData(const VkPhysicalDeviceProperties& deviceProps) {
+	std::vector<char> data{ readFile(pipelineCacheFile) };
+	VkPipelineCacheHeaderVersionOne header{};
+	if (data.size() < sizeof(header)) {
+		return {};
+	}
+	memcpy(&header, data.data(), sizeof(header));
+	if ((header.headerSize < sizeof(header)) || (header.headerVersion != VK_PIPELINE_CACHE_HEADER_VERSION_ONE) || (header.vendorID != deviceProps.vendorID) || (header.deviceID != deviceProps.deviceID) || (memcmp(header.pipelineCacheUUID, deviceProps.pipelineCacheUUID, VK_UUID_SIZE) != 0)) {
+		return {};
+	}
+	return data;
+}
+
+static void savePipelineCacheData() {
+	size_t size{ 0 };
+	if (vkGetPipelineCacheData(device, pipelineCache, &size, nullptr) != VK_SUCCESS) {
+		return;
+	}
+	std::vector<char> data(size);
+	if (vkGetPipelineCacheData(device, pipelineCache, &size, data.data()) != VK_SUCCESS) {
+		return;
+	}
+	writeFileAtomic(pipelineCacheFile, data.data(), size);
+}
+
+// SPIR-V is cached on disk, keyed by everything that affects the compiler output, so the Slang session is only created on a cache miss
+static std::vector<uint32_t> loadShaderSpirv(const char* moduleName, const std::filesystem::path& fileName, const std::vector<slang::PreprocessorMacroDesc>& macros = {}) {
+	const std::vector<char> source{ readFile(fileName) };
+	chk(!source.empty());
+	uint64_t key{ hashData(source.data(), source.size()) };
+	key = hashString(spGetBuildTagString(), key);
+	key = hashString(shaderProfile, key);
+	const SlangMatrixLayoutMode matrixLayout{ SLANG_MATRIX_LAYOUT_COLUMN_MAJOR };
+	key = hashData(&matrixLayout, sizeof(matrixLayout), key);
+	for (const auto& option : shaderCompilerOptions) {
+		key = hashData(&option.name, sizeof(option.name), key);
+		key = hashData(&option.value.kind, sizeof(option.value.kind), key);
+		key = hashData(&option.value.intValue0, sizeof(option.value.intValue0), key);
+		key = hashData(&option.value.intValue1, sizeof(option.value.intValue1), key);
+		key = hashString(option.value.stringValue0, key);
+		key = hashString(option.value.stringValue1, key);
+	}
+	for (const auto& macro : macros) {
+		key = hashString(macro.name, key);
+		key = hashString(macro.value, key);
+	}
+	const std::filesystem::path cacheFile{ cacheDir / std::format("{}_{:016x}.spv", moduleName, key) };
+	const std::vector<char> cached{ readFile(cacheFile) };
+	if (!cached.empty() && (cached.size() % sizeof(uint32_t) == 0)) {
+		std::vector<uint32_t> spirv(cached.size() / sizeof(uint32_t));
+		memcpy(spirv.data(), cached.data(), cached.size());
+		return spirv;
+	}
+	// Cache miss, compile with Slang (the global session isn't thread-safe)
+	std::lock_guard<std::mutex> slangLock(slangMutex);
+	auto phaseStart{ Clock::now() };
+	if (!slangGlobalSession) {
+		slang::createGlobalSession(slangGlobalSession.writeRef());
+	}
+	auto targets{ std::to_array<slang::TargetDesc>({ {.format{SLANG_SPIRV}, .profile{slangGlobalSession->findProfile(shaderProfile)} } }) };
+	slang::SessionDesc desc{ .targets{targets.data()}, .targetCount{SlangInt(targets.size())}, .defaultMatrixLayoutMode = matrixLayout, .preprocessorMacros = macros.data(), .preprocessorMacroCount = SlangInt(macros.size()), .compilerOptionEntries{const_cast<slang::CompilerOptionEntry*>(shaderCompilerOptions.data())}, .compilerOptionEntryCount{uint32_t(shaderCompilerOptions.size())} };
+	Slang::ComPtr<slang::ISession> slangSession;
+	slangGlobalSession->createSession(desc, slangSession.writeRef());
+	recordStartupPhase("slang_session", phaseStart);
+	phaseStart = Clock::now();
+	const std::string sourceString(source.begin(), source.end());
+	Slang::ComPtr<slang::IBlob> diagnostics;
+	Slang::ComPtr<slang::IModule> slangModule{ slangSession->loadModuleFromSourceString(moduleName, fileName.string().c_str(), sourceString.c_str(), diagnostics.writeRef()) };
+	if (!slangModule) {
+		std::cerr << (diagnostics ? (const char*)diagnostics->getBufferPointer() : "Shader compilation failed") << "\n";
+		exit(-1);
+	}
+	Slang::ComPtr<ISlangBlob> spirvBlob;
+	slangModule->getTargetCode(0, spirvBlob.writeRef());
+	chk(spirvBlob != nullptr);
+	recordStartupPhase("shader_compile", phaseStart);
+	writeFileAtomic(cacheFile, spirvBlob->getBufferPointer(), spirvBlob->getBufferSize());
+	std::vector<uint32_t> spirv(spirvBlob->getBufferSize() / sizeof(uint32_t));
+	memcpy(spirv.data(), spirvBlob->getBufferPointer(), spirvBlob->getBufferSize());
+	return spirv;
+}
+
+// frameSize must be a multiple of the alignment, so every frame's region starts aligned
+static void uniformRingCreate(VkDeviceSize frameSize, VkDeviceSize alignment) {
+	VkBufferCreateInfo bufferCI{ .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO, .size = frameSize * maxFramesInFlight, .usage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT };
+	// Always host visible, as the matrices are written straight into the mapped memory (late, with --late-latch)
+	VmaAllocationCreateInfo allocCI{ .flags = VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT, .usage = VMA_MEMORY_USAGE_AUTO };
+	VmaAllocationInfo allocInfo{};
+	chk(vmaCreateBuffer(allocator, &bufferCI, &allocCI, &uniformRing.buffer, &uniformRing.allocation, &allocInfo));
+	uniformRing.mapped = static_cast<char*>(allocInfo.pMappedData);
+	uniformRing.alignment = alignment;
+	uniformRing.frameSize = frameSize;
+}
+
+// The region of a frame is only reused once the frame timeline says the previous frame using it has finished
+static void uniformRingBeginFrame(uint32_t frame) {
+	uniformRing.frameStart = frame * uniformRing.frameSize;
+	uniformRing.head = uniformRing.frameStart;
+}
+
+// Returns the offset of a block of uniform memory in the current frame's region
+static VkDeviceSize uniformRingAlloc(VkDeviceSize size) {
+	const VkDeviceSize offset{ (uniformRing.head + uniformRing.alignment - 1) / uniformRing.alignment * uniformRing.alignment };
+	if (offset + size > uniformRing.frameStart + uniformRing.frameSize) {
+		std::cerr << "Uniform data of the frame exceeds the uniform ring region of " << uniformRing.frameSize << " bytes\n";
+		exit(-1);
+	}
+	uniformRing.head = offset + size;
+	return offset;
+}
+
+static void uniformRingFlush() {
+	chk(vmaFlushAllocation(allocator, uniformRing.allocation, uniformRing.frameStart, uniformRing.head - uniformRing.frameStart));
+}
+
+// Persistently mapped staging memory shared by all uploads
+// Sub-allocated linearly and recycled once the timeline value of the submission that read from it has been reached
+struct StagingRing {
+	VkBuffer buffer{ VK_NULL_HANDLE };
+	VmaAllocation allocation{ VK_NULL_HANDLE };
+	char* mapped{ nullptr };
+	VkDeviceSize size{ 0 };
+	// Monotonic byte counters, the position in the buffer is the counter modulo size
+	VkDeviceSize head{ 0 };
+	VkDeviceSize tail{ 0 };
+	// Uploads larger than the ring get a buffer of their own, destroyed with the submission that read from it
+	struct DedicatedBuffer {
+		VkBuffer buffer{ VK_NULL_HANDLE };
+		VmaAllocation allocation{ VK_NULL_HANDLE };
+	};
+	std::vector<DedicatedBuffer> unsubmittedBuffers;
+	struct Submission {
+		VkSemaphore semaphore{ VK_NULL_HANDLE };
+		uint64_t value{ 0 };
+		VkDeviceSize end{ 0 };
+		std::vector<DedicatedBuffer> dedicatedBuffers;
+	};
+	std::deque<Submission> submissions;
+} stagingRing;
+const VkDeviceSize stagingRingSize{ 32 * 1024 * 1024 };
+
+// Where an upload's data has to be written to, and the buffer to copy from
+struct StagingBlock {
+	VkBuffer buffer{ VK_NULL_HANDLE };
+	VkDeviceSize offset{ 0 };
+	char* data{ nullptr };
+};
+
+static void stagingRingCreate(VkDeviceSize size) {
+	VkBufferCreateInfo bufferCI{ .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO, .size = size, .usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT };
+	VmaAllocationCreateInfo allocCI{ .flags = VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT, .usage = VMA_MEMORY_USAGE_AUTO };
+	VmaAllocationInfo allocInfo{};
+	chk(vmaCreateBuffer(allocator, &bufferCI, &allocCI, &stagingRing.buffer, &stagingRing.allocation, &allocInfo));
+	stagingRing.mapped = static_cast<char*>(allocInfo.pMappedData);
+	stagingRing.size = size;
+}
+
+// Releases the memory of all submissions the GPU has finished, optionally blocks until the oldest one has finished
+static void stagingRingRecycle(bool waitForOldest) {
+	while (!stagingRing.submissions.empty()) {
+		const auto& submission{ stagingRing.submissions.front() };
+		uint64_t value{ 0 };
+		chk(vkGetSemaphoreCounterValue(device, submission.semaphore, &value));
+		if (value < submission.value) {
+			if (!waitForOldest) {
+				break;
+			}
+			VkSemaphoreWaitInfo waitInfo{ .sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO, .semaphoreCount = 1, .pSemaphores = &submission.semaphore, .pValues = &submission.value };
+			chk(vkWaitSemaphores(device, &waitInfo, UINT64_MAX));
+			waitForOldest = false;
+		}
+		stagingRing.tail = submission.end;
+		for (const auto& dedicated : submission.dedicatedBuffers) {
+			vmaDestroyBuffer(allocator, dedicated.buffer, dedicated.allocation);
+		}
+		stagingRing.submissions.pop_front();
+	}
+}
+
+// Returns a block of staging memory, allocations never wrap around the end of the buffer
+static StagingBlock stagingRingAlloc(VkDeviceSize size, VkDeviceSize alignment) {
+	if (size > stagingRing.size) {
+		StagingRing::DedicatedBuffer dedicated{};
+		VkBufferCreateInfo bufferCI{ .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO, .size = size, .usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT };
+		VmaAllocationCreateInfo allocCI{ .flags = VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT, .usage = VMA_MEMORY_USAGE_AUTO };
+		VmaAllocationInfo allocInfo{};
+		chk(vmaCreateBuffer(allocator, &bufferCI, &allocCI, &dedicated.buffer, &dedicated.allocation, &allocInfo));
+		stagingRing.unsubmittedBuffers.push_back(dedicated);
+		return { .buffer = dedicated.buffer, .offset = 0, .data = static_cast<char*>(allocInfo.pMappedData) };
+	}
+	stagingRingRecycle(false);
+	while (true) {
+		VkDeviceSize offset{ stagingRing.head % stagingRing.size };
+		VkDeviceSize lapStart{ stagingRing.head - offset };
+		offset = (offset + alignment - 1) / alignment * alignment;
+		if (offset + size > stagingRing.size) {
+			lapStart += stagingRing.size;
+			offset = 0;
+		}
+		if (lapStart + offset + size - stagingRing.tail <= stagingRing.size) {
+			stagingRing.head = lapStart + offset + size;
+			return { .buffer = stagingRing.buffer, .offset = offset, .data = stagingRing.mapped + offset };
+		}
+		// Not enough space left, which can only be resolved if there is a submission to wait for
+		if (stagingRing.submissions.empty()) {
+			std::cerr << "Staging ring exhausted by uploads that have not been submitted\n";
+			exit(-1);
+		}
+		stagingRingRecycle(true);
+	}
+}
+
+// Call right before the submission that reads the staged data
+// Flushes the host writes, everything allocated so far may be reused once the semaphore reaches the given value
+static void stagingRingSubmit(VkSemaphore semaphore, uint64_t value) {
+	chk(vmaFlushAllocation(allocator, stagingRing.allocation, 0, VK_WHOLE_SIZE));
+	for (const auto& dedicated : stagingRing.unsubmittedBuffers) {
+		chk(vmaFlushAllocation(allocator, dedicated.allocation, 0, VK_WHOLE_SIZE));
+	}
+	stagingRing.submissions.push_back({ .semaphore = semaphore, .value = value, .end = stagingRing.head, .dedicatedBuffers = std::move(stagingRing.unsubmittedBuffers) });
+	stagingRing.unsubmittedBuffers.clear();
+}
+
+static VkCommandBuffer beginUpload() {
+	VkCommandBuffer cb{};
+	VkCommandBufferAllocateInfo cbAI{ .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO, .commandPool = uploadCommandPool, .commandBufferCount = 1 };
+	chk(vkAllocateCommandBuffers(device, &cbAI, &cb));
+	VkCommandBufferBeginInfo cbBI{ .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO, .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT };
+	chk(vkBeginCommandBuffer(cb, &cbBI));
+	return cb;
+}
+
+// Submits to the upload queue without waiting, returns the upload timeline value that is signaled once the upload has finished
+static uint64_t submitUpload(VkCommandBuffer cb) {
+	chk(vkEndCommandBuffer(cb));
+	uploadTimelineValue++;
+	VkTimelineSemaphoreSubmitInfo timelineSI{ .sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO, .signalSemaphoreValueCount = 1, .pSignalSemaphoreValues = &uploadTimelineValue };
+	VkSubmitInfo submitInfo{ .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO, .pNext = &timelineSI, .commandBufferCount = 1, .pCommandBuffers = &cb, .signalSemaphoreCount = 1, .pSignalSemaphores = &uploadTimeline };
+	stagingRingSubmit(uploadTimeline, uploadTimelineValue);
+	chk(vkQueueSubmit(uploadQueue, 1, &submitInfo, VK_NULL_HANDLE));
+	uploadCommandBuffers.push_back({ .commandBuffer = cb, .value = uploadTimelineValue });
+	return uploadTimelineValue;
+}
+
+// Frees the command buffers and staging memory of all uploads the GPU has finished
+static void retireUploads() {
+	uint64_t value{ 0 };
+	chk(vkGetSemaphoreCounterValue(device, uploadTimeline, &value));
+	while (!uploadCommandBuffers.empty() && (uploadCommandBuffers.front().value <= value)) {
+		vkFreeCommandBuffers(device, uploadCommandPool, 1, &uploadCommandBuffers.front().commandBuffer);
+		uploadCommandBuffers.pop_front();
+	}
+	stagingRingRecycle(false);
+}
+
+struct TextureFormat {
+	VkFormat unorm{ VK_FORMAT_UNDEFINED };
+	VkFormat srgb{ VK_FORMAT_UNDEFINED };
+	// Bytes per texel for uncompressed, bytes per block for block compressed formats
+	uint32_t blockSize{ 0 };
+};
+
+static TextureFormat getTextureFormat(ddsktx_format format) {
+	switch (format) {
+	case DDSKTX_FORMAT_BC1: return { VK_FORMAT_BC1_RGBA_UNORM_BLOCK, VK_FORMAT_BC1_RGBA_SRGB_BLOCK, 8 };
+	case DDSKTX_FORMAT_BC2: return { VK_FORMAT_BC2_UNORM_BLOCK, VK_FORMAT_BC2_SRGB_BLOCK, 16 };
+	case DDSKTX_FORMAT_BC3: return { VK_FORMAT_BC3_UNORM_BLOCK, VK_FORMAT_BC3_SRGB_BLOCK, 16 };
+	case DDSKTX_FORMAT_BC4: return { VK_FORMAT_BC4_UNORM_BLOCK, VK_FORMAT_UNDEFINED, 8 };
+	case DDSKTX_FORMAT_BC5: return { VK_FORMAT_BC5_UNORM_BLOCK, VK_FORMAT_UNDEFINED, 16 };
+	case DDSKTX_FORMAT_BC6H: return { VK_FORMAT_BC6H_UFLOAT_BLOCK, VK_FORMAT_UNDEFINED, 16 };
+	case DDSKTX_FORMAT_BC7: return { VK_FORMAT_BC7_UNORM_BLOCK, VK_FORMAT_BC7_SRGB_BLOCK, 16 };
+	// ETC1 is a subset of ETC2
+	case DDSKTX_FORMAT_ETC1: return { VK_FORMAT_ETC2_R8G8B8_UNORM_BLOCK, VK_FORMAT_ETC2_R8G8B8_SRGB_BLOCK, 8 };
+	case DDSKTX_FORMAT_ETC2: return { VK_FORMAT_ETC2_R8G8B8_UNORM_BLOCK, VK_FORMAT_ETC2_R8G8B8_SRGB_BLOCK, 8 };
+	case DDSKTX_FORMAT_ETC2A: return { VK_FORMAT_ETC2_R8G8B8A8_UNORM_BLOCK, VK_FORMAT_ETC2_R8G8B8A8_SRGB_BLOCK, 16 };
+	case DDSKTX_FORMAT_ETC2A1: return { VK_FORMAT_ETC2_R8G8B8A1_UNORM_BLOCK, VK_FORMAT_ETC2_R8G8B8A1_SRGB_BLOCK, 8 };
+	case DDSKTX_FORMAT_ASTC4x4: return { VK_FORMAT_ASTC_4x4_UNORM_BLOCK, VK_FORMAT_ASTC_4x4_SRGB_BLOCK, 16 };
+	case DDSKTX_FORMAT_ASTC5x5: return { VK_FORMAT_ASTC_5x5_UNORM_BLOCK, VK_FORMAT_ASTC_5x5_SRGB_BLOCK, 16 };
+	case DDSKTX_FORMAT_ASTC6x6: return { VK_FORMAT_ASTC_6x6_UNORM_BLOCK, VK_FORMAT_ASTC_6x6_SRGB_BLOCK, 16 };
+	case DDSKTX_FORMAT_ASTC8x5: return { VK_FORMAT_ASTC_8x5_UNORM_BLOCK, VK_FORMAT_ASTC_8x5_SRGB_BLOCK, 16 };
+	case DDSKTX_FORMAT_ASTC8x6: return { VK_FORMAT_ASTC_8x6_UNORM_BLOCK, VK_FORMAT_ASTC_8x6_SRGB_BLOCK, 16 };
+	case DDSKTX_FORMAT_ASTC10x5: return { VK_FORMAT_ASTC_10x5_UNORM_BLOCK, VK_FORMAT_ASTC_10x5_SRGB_BLOCK, 16 };
+	case DDSKTX_FORMAT_R8: return { VK_FORMAT_R8_UNORM, VK_FORMAT_UNDEFINED, 1 };
+	case DDSKTX_FORMAT_RG8: return { VK_FORMAT_R8G8_UNORM, VK_FORMAT_UNDEFINED, 2 };
+	case DDSKTX_FORMAT_RG8S: return { VK_FORMAT_R8G8_SNORM, VK_FORMAT_UNDEFINED, 2 };
+	case DDSKTX_FORMAT_RGB8: return { VK_FORMAT_R8G8B8_UNORM, VK_FORMAT_R8G8B8_SRGB, 3 };
+	case DDSKTX_FORMAT_RGBA8: return { VK_FORMAT_R8G8B8A8_UNORM, VK_FORMAT_R8G8B8A8_SRGB, 4 };
+	case DDSKTX_FORMAT_RGBA8S: return { VK_FORMAT_R8G8B8A8_SNORM, VK_FORMAT_UNDEFINED, 4 };
+	case DDSKTX_FORMAT_BGRA8: return { VK_FORMAT_B8G8R8A8_UNORM, VK_FORMAT_B8G8R8A8_SRGB, 4 };
+	case DDSKTX_FORMAT_R16: return { VK_FORMAT_R16_UNORM, VK_FORMAT_UNDEFINED, 2 };
+	case DDSKTX_FORMAT_R16F: return { VK_FORMAT_R16_SFLOAT, VK_FORMAT_UNDEFINED, 2 };
+	case DDSKTX_FORMAT_RG16: return { VK_FORMAT_R16G16_UNORM, VK_FORMAT_UNDEFINED, 4 };
+	case DDSKTX_FORMAT_RG16F: return { VK_FORMAT_R16G16_SFLOAT, VK_FORMAT_UNDEFINED, 4 };
+	case DDSKTX_FORMAT_RG16S: return { VK_FORMAT_R16G16_SNORM, VK_FORMAT_UNDEFINED, 4 };
+	case DDSKTX_FORMAT_RGBA16: return { VK_FORMAT_R16G16B16A16_UNORM, VK_FORMAT_UNDEFINED, 8 };
+	case DDSKTX_FORMAT_RGBA16F: return { VK_FORMAT_R16G16B16A16_SFLOAT, VK_FORMAT_UNDEFINED, 8 };
+	case DDSKTX_FORMAT_R32F: return { VK_FORMAT_R32_SFLOAT, VK_FORMAT_UNDEFINED, 4 };
+	case DDSKTX_FORMAT_RGB10A2: return { VK_FORMAT_A2B10G10R10_UNORM_PACK32, VK_FORMAT_UNDEFINED, 4 };
+	case DDSKTX_FORMAT_RG11B10F: return { VK_FORMAT_B10G11R11_UFLOAT_PACK32, VK_FORMAT_UNDEFINED, 4 };
+	// PVRTC, ATC and A8 have no (non-deprecated) Vulkan equivalent
+	default: return {};
+	}
+}
+
+// Picks the sRGB or UNORM variant of the file's format, falling back to the other one if the device can't sample/upload it, VK_FORMAT_UNDEFINED if neither works
+static VkFormat selectTextureFormat(const ddsktx_texture_info& info, const TextureFormat& textureFormat) {
+	// 8-bit color formats have always been treated as sRGB, as most KTX/DDS writers don't store that intent
+	const bool preferSrgb{ (info.flags & DDSKTX_TEXTURE_FLAG_SRGB) || (info.format == DDSKTX_FORMAT_RGBA8) || (info.format == DDSKTX_FORMAT_BGRA8) || (info.format == DDSKTX_FORMAT_RGB8) };
+	const VkFormat candidates[2]{ preferSrgb ? textureFormat.srgb : textureFormat.unorm, preferSrgb ? textureFormat.unorm : textureFormat.srgb };
+	const VkFormatFeatureFlags requiredFeatures{ VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT | VK_FORMAT_FEATURE_TRANSFER_DST_BIT };
+	for (auto format : candidates) {
+		VkFormatProperties formatProps{};
+		if (format != VK_FORMAT_UNDEFINED) {
+			vkGetPhysicalDeviceFormatProperties(physicalDevice, format, &formatProps);
+			if ((formatProps.optimalTilingFeatures & requiredFeatures) == requiredFeatures) {
+				return format;
+			}
+		}
+	}
+	return VK_FORMAT_UNDEFINED;
+}
+
+// Writes RGB8 texels as RGBA8 with opaque alpha, source rows may be padded
+static void expandRgbToRgba(const ddsktx_sub_data& sub, char* dst) {
+	uint8_t* out{ reinterpret_cast<uint8_t*>(dst) };
+	for (int y = 0; y < sub.height; y++) {
+		const uint8_t* row{ static_cast<const uint8_t*>(sub.buff) + (size_t)y * sub.row_pitch_bytes };
+		for (int x = 0; x < sub.width; x++) {
+			*out++ = row[x * 3];
+			*out++ = row[x * 3 + 1];
+			*out++ = row[x * 3 + 2];
+			*out++ = 0xFF;
+		}
+	}
+}
+
+static TextureFile loadTextureFile(const std::filesystem::path& fileName) {
+	const auto phaseStart{ Clock::now() };
+	TextureFile textureFile{ .file{ std::make_unique<MappedFile>(fileName) } };
+	chk(textureFile.file->data != nullptr);
+	chk(ddsktx_parse(&textureFile.info, textureFile.file->data, (int)textureFile.file->size, nullptr));
+	recordStartupPhase("ktx_read", phaseStart);
+	return textureFile;
+}
+
+// Image layout must be TRANSFER_DST_OPTIMAL for all levels, all levels are left in TRANSFER_SRC_OPTIMAL
+static void recordMipBlits(VkCommandBuffer cb, VkImage image, VkExtent2D extent, uint32_t mipLevels, uint32_t layerCount) {
+	for (uint32_t i = 1; i <= mipLevels; i++) {
+		VkImageMemoryBarrier barrier{
+			.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+			.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+			.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT,
+			.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+			.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+			.image = image,
+			.subresourceRange = {.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT, .baseMipLevel = i - 1, .levelCount = 1, .layerCount = layerCount }
+		};
+		vkCmdPipelineBarrier(cb, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+		if (i == mipLevels) {
+			break;
+		}
+		VkImageBlit blit{
+			.srcSubresource{.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT, .mipLevel = i - 1, .layerCount = layerCount },
+			.srcOffsets{ {}, {.x = std::max(int32_t(extent.width >> (i - 1)), 1), .y = std::max(int32_t(extent.height >> (i - 1)), 1), .z = 1 } },
+			.dstSubresource{.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT, .mipLevel = i, .layerCount = layerCount },
+			.dstOffsets{ {}, {.x = std::max(int32_t(extent.width >> i), 1), .y = std::max(int32_t(extent.height >> i), 1), .z = 1 } },
+		};
+		vkCmdBlitImage(cb, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &blit, VK_FILTER_LINEAR);
+	}
+}
+
+// Compute fallback for formats that support storage (directly or through a UNORM alias) but not blitting
+// Image layout must be TRANSFER_DST_OPTIMAL for all levels, all levels are left in GENERAL
+// Returns a function that releases the temporary objects once the command buffer has finished execution
+static std::function<void()> recordMipCompute(VkCommandBuffer cb, VkImage image, VkFormat format, VkFormat storageFormat, VkExtent2D extent, uint32_t mipLevels, uint32_t layerCount) {
+	const std::vector<uint32_t> spirv{ loadShaderSpirv("downsample", "assets/downsample.slang") };
+	VkShaderModuleCreateInfo shaderModuleCI{ .sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO, .codeSize = spirv.size() * sizeof(uint32_t), .pCode = spirv.data() };
+	VkShaderModule shaderModule{};
+	chk(vkCreateShaderModule(device, &shaderModuleCI, nullptr, &shaderModule));
+	struct PushConsts {
+		uint32_t dstSize[2];
+		uint32_t srgb;
+	};
+	const VkDescriptorSetLayoutBinding bindings[2]{
+		{.binding = 0, .descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, .descriptorCount = 1, .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT },
+		{.binding = 1, .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, .descriptorCount = 1, .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT }
+	};
+	VkDescriptorSetLayoutCreateInfo setLayoutCI{ .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO, .bindingCount = 2, .pBindings = bindings };
+	VkDescriptorSetLayout setLayout{};
+	chk(vkCreateDescriptorSetLayout(device, &setLayoutCI, nullptr, &setLayout));
+	VkPushConstantRange pushConstRange{ .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT, .size = sizeof(PushConsts) };
+	VkPipelineLayoutCreateInfo layoutCI{ .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO, .setLayoutCount = 1, .pSetLayouts = &setLayout, .pushConstantRangeCount = 1, .pPushConstantRanges = &pushConstRange };
+	VkPipelineLayout layout{};
+	chk(vkCreatePipelineLayout(device, &layoutCI, nullptr, &layout));
+	VkComputePipelineCreateInfo pipelineCI{
+		.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
+		.stage{.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO, .stage = VK_SHADER_STAGE_COMPUTE_BIT, .module = shaderModule, .pName = "main" },
+		.layout = layout
+	};
+	VkPipeline computePipeline{};
+	chk(vkCreateComputePipelines(device, pipelineCache, 1, &pipelineCI, nullptr, &computePipeline));
+	vkDestroyShaderModule(device, shaderModule, nullptr);
+	VkSamplerCreateInfo samplerCI{ .sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO, .magFilter = VK_FILTER_LINEAR, .minFilter = VK_FILTER_LINEAR, .addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE, .addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE, .addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE };
+	VkSampler sampler{};
+	chk(vkCreateSampler(device, &samplerCI, nullptr, &sampler));
+	VkDescriptorPoolSize poolSizes[2]{ {.type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, .descriptorCount = mipLevels }, {.type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, .descriptorCount = mipLevels } };
+	VkDescriptorPoolCreateInfo poolCI{ .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO, .maxSets = mipLevels, .poolSizeCount = 2, .pPoolSizes = poolSizes };
+	VkDescriptorPool pool{};
+	chk(vkCreateDescriptorPool(device, &poolCI, nullptr, &pool));
+	VkImageMemoryBarrier barrier{
+		.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+		.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+		.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+		.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+		.newLayout = VK_IMAGE_LAYOUT_GENERAL,
+		.image = image,
+		.subresourceRange = {.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT, .levelCount = mipLevels, .layerCount = layerCount }
+	};
+	vkCmdPipelineBarrier(cb, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+	vkCmdBindPipeline(cb, VK_PIPELINE_BIND_POINT_COMPUTE, computePipeline);
+	std::vector<VkImageView> views;
+	for (uint32_t i = 1; i < mipLevels; i++) {
+		VkImageViewUsageCreateInfo viewUsageCI{ .sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_USAGE_CREATE_INFO, .usage = VK_IMAGE_USAGE_SAMPLED_BIT };
+		VkImageViewCreateInfo viewCI{ .sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO, .pNext = &viewUsageCI, .image = image, .viewType = VK_IMAGE_VIEW_TYPE_2D_ARRAY, .format = format, .subresourceRange = {.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT, .baseMipLevel = i - 1, .levelCount = 1, .layerCount = layerCount } };
+		VkImageView srcView{}, dstView{};
+		chk(vkCreateImageView(device, &viewCI, nullptr, &srcView));
+		viewUsageCI.usage = VK_IMAGE_USAGE_STORAGE_BIT;
+		viewCI.format = storageFormat;
+		viewCI.subresourceRange.baseMipLevel = i;
+		chk(vkCreateImageView(device, &viewCI, nullptr, &dstView));
+		views.insert(views.end(), { srcView, dstView });
+		VkDescriptorSetAllocateInfo setAI{ .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO, .descriptorPool = pool, .descriptorSetCount = 1, .pSetLayouts = &setLayout };
+		VkDescriptorSet set{};
+		chk(vkAllocateDescriptorSets(device, &setAI, &set));
+		VkDescriptorImageInfo srcInfo{ .sampler = sampler, .imageView = srcView, .imageLayout = VK_IMAGE_LAYOUT_GENERAL };
+		VkDescriptorImageInfo dstInfo{ .imageView = dstView, .imageLayout = VK_IMAGE_LAYOUT_GENERAL };
+		VkWriteDescriptorSet writes[2]{
+			{.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET, .dstSet = set, .dstBinding = 0, .descriptorCount = 1, .descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, .pImageInfo = &srcInfo },
+			{.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET, .dstSet = set, .dstBinding = 1, .descriptorCount = 1, .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, .pImageInfo = &dstInfo }
+		};
+		vkUpdateDescriptorSets(device, 2, writes, 0, nullptr);
+		const PushConsts pushConsts{ .dstSize{ std::max(extent.width >> i, 1u), std::max(extent.height >> i, 1u) }, .srgb = (format != storageFormat) ? 1u : 0u };
+		vkCmdBindDescriptorSets(cb, VK_PIPELINE_BIND_POINT_COMPUTE, layout, 0, 1, &set, 0, nullptr);
+		vkCmdPushConstants(cb, layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(PushConsts), &pushConsts);
+		vkCmdDispatch(cb, (pushConsts.dstSize[0] + 7) / 8, (pushConsts.dstSize[1] + 7) / 8, layerCount);
+		// Make this level visible as the source of the next dispatch
+		VkImageMemoryBarrier levelBarrier{
+			.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+			.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+			.dstAccessMask = VK_ACCESS_SHADER_READ_BIT,
+			.oldLayout = VK_IMAGE_LAYOUT_GENERAL,
+			.newLayout = VK_IMAGE_LAYOUT_GENERAL,
+			.image = image,
+			.subresourceRange = {.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT, .baseMipLevel = i, .levelCount = 1, .layerCount = layerCount }
+		};
+		vkCmdPipelineBarrier(cb, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &levelBarrier);
+	}
+	return [=]() {
+		for (auto view : views) {
+			vkDestroyImageView(device, view, nullptr);
+		}
+		vkDestroyDescriptorPool(device, pool, nullptr);
+		vkDestroySampler(device, sampler, nullptr);
+		vkDestroyPipeline(device, computePipeline, nullptr);
+		vkDestroyPipelineLayout(device, layout, nullptr);
+		vkDestroyDescriptorSetLayout(device, setLayout, nullptr);
+	};
+}
+
+// Creates the texture and submits its upload without waiting for it, frames sample the placeholder until the upload timeline reaches texture.uploadValue
+static void startTextureUpload(TextureFile& ktxFile) {
+	auto phaseStart{ Clock::now() };
+	const ddsktx_texture_info& tc{ ktxFile.info };
+	const uint32_t texFaceCount{ (tc.flags & DDSKTX_TEXTURE_FLAG_CUBEMAP) ? 6u : 1u };
+	const uint32_t texLayerCount{ (uint32_t)std::max(tc.num_layers, 1) * texFaceCount };
+	TextureFormat texFormatInfo{ getTextureFormat(tc.format) };
+	VkFormat texFormat{ selectTextureFormat(tc, texFormatInfo) };
+	// Desktop GPUs usually can't sample RGB8, so it's expanded to RGBA8 while staging
+	const bool texExpandRgb{ (texFormat == VK_FORMAT_UNDEFINED) && (tc.format == DDSKTX_FORMAT_RGB8) };
+	if (texExpandRgb) {
+		texFormatInfo = getTextureFormat(DDSKTX_FORMAT_RGBA8);
+		texFormat = selectTextureFormat(tc, texFormatInfo);
+	}
+	if (texFormat == VK_FORMAT_UNDEFINED) {
+		std::cerr << "Texture format " << ddsktx_format_str(tc.format) << " is not supported by this device\n";
+		exit(-1);
+	}
+	// Textures without a mip chain get their mips generated on the GPU, preferably with blits, with a compute fallback
+	enum class MipGen { None, Blit, Compute } texMipGen{ MipGen::None };
+	const VkFormat texStorageFormat{ (texFormat == VK_FORMAT_R8G8B8A8_SRGB) ? VK_FORMAT_R8G8B8A8_UNORM : (texFormat == VK_FORMAT_B8G8R8A8_SRGB) ? VK_FORMAT_B8G8R8A8_UNORM : texFormat };
+	uint32_t texMipLevels{ (uint32_t)tc.num_mips };
+	if ((tc.num_mips == 1) && (std::max(tc.width, tc.height) > 1)) {
+		VkFormatProperties formatProps{};
+		vkGetPhysicalDeviceFormatProperties(physicalDevice, texFormat, &formatProps);
+		// The downsample shader writes its target without a format, which has to be supported by the storage view's format
+		VkFormatProperties3 storageFormatProps3{ .sType = VK_STRUCTURE_TYPE_FORMAT_PROPERTIES_3 };
+		VkFormatProperties2 storageFormatProps{ .sType = VK_STRUCTURE_TYPE_FORMAT_PROPERTIES_2, .pNext = &storageFormatProps3 };
+		vkGetPhysicalDeviceFormatProperties2(physicalDevice, texStorageFormat, &storageFormatProps);
+		const VkFormatFeatureFlags2 storageFeatures{ VK_FORMAT_FEATURE_2_STORAGE_IMAGE_BIT | VK_FORMAT_FEATURE_2_STORAGE_WRITE_WITHOUT_FORMAT_BIT };
+		const VkFormatFeatureFlags blitFeatures{ VK_FORMAT_FEATURE_BLIT_SRC_BIT | VK_FORMAT_FEATURE_BLIT_DST_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT };
+		if ((formatProps.optimalTilingFeatures & blitFeatures) == blitFeatures) {
+			texMipGen = MipGen::Blit;
+		} else if ((formatProps.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT) && ((storageFormatProps3.optimalTilingFeatures & storageFeatures) == storageFeatures)) {
+			texMipGen = MipGen::Compute;
+		}
+		if (texMipGen != MipGen::None) {
+			texMipLevels = (uint32_t)std::floor(std::log2(std::max(tc.width, tc.height))) + 1;
+		}
+	}
+	VmaAllocationCreateInfo uImageAllocCI{ .flags = VMA_ALLOCATION_CREATE_DEDICATED_MEMORY_BIT, .usage = VMA_MEMORY_USAGE_AUTO, .priority = 1.0f };
+	VkImageCreateInfo texImgCI{
+		.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+		.flags = ((texFaceCount == 6) ? VK_IMAGE_CREATE_CUBE_COMPATIBLE_BIT : 0u) | ((texMipGen == MipGen::Compute) && (texStorageFormat != texFormat) ? VK_IMAGE_CREATE_MUTABLE_FORMAT_BIT | VK_IMAGE_CREATE_EXTENDED_USAGE_BIT : 0u),
+		.imageType = VK_IMAGE_TYPE_2D,
+		.format = texFormat,
+		.extent = {.width = (uint32_t)tc.width, .height = (uint32_t)tc.height, .depth = 1 },
+		.mipLevels = texMipLevels,
+		.arrayLayers = texLayerCount,
+		.samples = VK_SAMPLE_COUNT_1_BIT,
+		.tiling = VK_IMAGE_TILING_OPTIMAL,
+		.usage = VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | ((texMipGen == MipGen::Blit) ? VK_IMAGE_USAGE_TRANSFER_SRC_BIT : 0u) | ((texMipGen == MipGen::Compute) ? VK_IMAGE_USAGE_STORAGE_BIT : 0u),
+		.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED
+	};
+	chk(vmaCreateImage(allocator, &texImgCI, &uImageAllocCI, &texture.image, &texture.allocation, nullptr));
+	// Storage usage may only be valid for the mip generation views, so this view is restricted to sampling
+	VkImageViewUsageCreateInfo texViewUsageCI{ .sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_USAGE_CREATE_INFO, .usage = VK_IMAGE_USAGE_SAMPLED_BIT };
+	VkImageViewCreateInfo texVewCI{ .sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO, .pNext = &texViewUsageCI, .image = texture.image, .viewType = VK_IMAGE_VIEW_TYPE_2D, .format = texImgCI.format, .subresourceRange = {.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT, .levelCount = texImgCI.mipLevels, .layerCount = 1 } };
+	chk(vkCreateImageView(device, &texVewCI, nullptr, &texture.view));
+	VkDescriptorSetAllocateInfo texDescSetAlloc{ .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO, .descriptorPool = descriptorPool, .descriptorSetCount = 1, .pSetLayouts = &descriptorSetLayoutTex };
+	chk(vkAllocateDescriptorSets(device, &texDescSetAlloc, &texture.descriptorSet));
+	// Sampler
+	VkSamplerCreateInfo samplerCI{
+		.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO,
+		.magFilter = VK_FILTER_LINEAR,
+		.minFilter = VK_FILTER_LINEAR,
+		.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR,
+		.anisotropyEnable = VK_TRUE,
+		.maxAnisotropy = 8.0f,
+		.maxLod = (float)texImgCI.mipLevels,
+	};
+	chk(vkCreateSampler(device, &samplerCI, nullptr, &texture.sampler));
+	VkDescriptorImageInfo descTexInfo{ .sampler = texture.sampler, .imageView = texture.view, .imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL };
+	VkWriteDescriptorSet writeDescSet{ .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET, .dstSet = texture.descriptorSet, .dstBinding = 0, .descriptorCount = 1, .descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, .pImageInfo = &descTexInfo };
+	vkUpdateDescriptorSets(device, 1, &writeDescSet, 0, nullptr);
+	recordStartupPhase("texture_create", phaseStart);
+	// Copy all mip levels (and array layers/cube faces) present in the file with a single staging allocation and copy command
+	phaseStart = Clock::now();
+	std::vector<ddsktx_sub_data> subData;
+	std::vector<VkBufferImageCopy> copyRegions;
+	VkDeviceSize stagingSize{ 0 };
+	// Copy offsets need to be a multiple of the texel/block size and of 4
+	const VkDeviceSize stagingAlignment{ std::lcm(VkDeviceSize(texFormatInfo.blockSize), VkDeviceSize(4)) };
+	for (uint32_t layer = 0; layer < texLayerCount / texFaceCount; layer++) {
+		for (uint32_t face = 0; face < texFaceCount; face++) {
+			for (uint32_t mip = 0; mip < (uint32_t)tc.num_mips; mip++) {
+				ddsktx_sub_data sub;
+				ddsktx_get_sub(&tc, &sub, ktxFile.file->data, (int)ktxFile.file->size, layer, face, mip);
+				stagingSize = (stagingSize + stagingAlignment - 1) / stagingAlignment * stagingAlignment;
+				copyRegions.push_back({
+					.bufferOffset = stagingSize,
+					.imageSubresource{.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT, .mipLevel = mip, .baseArrayLayer = layer * texFaceCount + face, .layerCount = 1 },
+					// Use the real mip size, which may not be a multiple of the block size
+					.imageExtent{.width = std::max((uint32_t)tc.width >> mip, 1u), .height = std::max((uint32_t)tc.height >> mip, 1u), .depth = 1 },
+				});
+				subData.push_back(sub);
+				stagingSize += texExpandRgb ? (VkDeviceSize)sub.width * sub.height * texFormatInfo.blockSize : sub.size_bytes;
+			}
+		}
+	}
+	VkCommandBuffer cbUpload{ beginUpload() };
+	const StagingBlock texStaging{ stagingRingAlloc(stagingSize, stagingAlignment) };
+	for (size_t i = 0; i < copyRegions.size(); i++) {
+		if (texExpandRgb) {
+			expandRgbToRgba(subData[i], texStaging.data + copyRegions[i].bufferOffset);
+		} else {
+			memcpy(texStaging.data + copyRegions[i].bufferOffset, subData[i].buff, subData[i].size_bytes);
+		}
+		copyRegions[i].bufferOffset += texStaging.offset;
+	}
+	ktxFile.file.reset();
+	VkImageMemoryBarrier barrierTex0{
+		.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+		.srcAccessMask = 0,
+		.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+		.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+		.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+		.image = texture.image,
+		.subresourceRange = {.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT, .levelCount = VK_REMAINING_MIP_LEVELS, .layerCount = VK_REMAINING_ARRAY_LAYERS }
+	};
+	vkCmdPipelineBarrier(cbUpload, VK_PIPELINE_STAGE_HOST_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrierTex0);
+	vkCmdCopyBufferToImage(cbUpload, texStaging.buffer, texture.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, (uint32_t)copyRegions.size(), copyRegions.data());
+	const VkExtent2D texExtent{ .width = (uint32_t)tc.width, .height = (uint32_t)tc.height };
+	// Mip generation needs a graphics queue, so with a dedicated transfer queue it runs on the graphics queue after the ownership transfer
+	auto recordFinish = [=](VkCommandBuffer cb) {
+		VkImageLayout texUploadLayout{ VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL };
+		VkPipelineStageFlags texUploadStage{ VK_PIPELINE_STAGE_TRANSFER_BIT };
+		if (texMipGen == MipGen::Blit) {
+			recordMipBlits(cb, texture.image, texExtent, texMipLevels, texLayerCount);
+			texUploadLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+		}
+		if (texMipGen == MipGen::Compute) {
+			texture.cleanup = recordMipCompute(cb, texture.image, texFormat, texStorageFormat, texExtent, texMipLevels, texLayerCount);
+			texUploadLayout = VK_IMAGE_LAYOUT_GENERAL;
+			texUploadStage = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+		}
+		VkImageMemoryBarrier barrierTex1{
+			.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+			.srcAccessMask = (texMipGen == MipGen::Compute) ? VK_ACCESS_SHADER_WRITE_BIT : VK_ACCESS_TRANSFER_WRITE_BIT,
+			.dstAccessMask = VK_ACCESS_SHADER_READ_BIT,
+			.oldLayout = texUploadLayout,
+			.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+			.image = texture.image,
+			.subresourceRange = {.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT, .levelCount = VK_REMAINING_MIP_LEVELS, .layerCount = VK_REMAINING_ARRAY_LAYERS }
+		};
+		vkCmdPipelineBarrier(cb, texUploadStage, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrierTex1);
+	};
+	if (uploadQueueFamily == queueFamily) {
+		recordFinish(cbUpload);
+	} else {
+		// Release from the upload queue family, the matching acquire is recorded into a graphics command buffer once the upload has finished
+		VkImageMemoryBarrier releaseBarrier{
+			.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+			.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+			.dstAccessMask = 0,
+			.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+			.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+			.srcQueueFamilyIndex = uploadQueueFamily,
+			.dstQueueFamilyIndex = queueFamily,
+			.image = texture.image,
+			.subresourceRange = {.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT, .levelCount = VK_REMAINING_MIP_LEVELS, .layerCount = VK_REMAINING_ARRAY_LAYERS }
+		};
+		vkCmdPipelineBarrier(cbUpload, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr, 0, nullptr, 1, &releaseBarrier);
+		texture.recordAcquire = [=](VkCommandBuffer cb) {
+			VkImageMemoryBarrier acquireBarrier{ releaseBarrier };
+			acquireBarrier.srcAccessMask = 0;
+			acquireBarrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+			vkCmdPipelineBarrier(cb, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &acquireBarrier);
+			recordFinish(cb);
+		};
+	}
+	texture.uploadValue = submitUpload(cbUpload);
+	recordStartupPhase("texture_upload_submit", phaseStart);
+}
+
+// Objects are queued with the current frame value, everything recorded up to and including that frame may still use them
+static void deferDeletion(std::function<void()> destroy) {
+	deletionQueue.push_back({ .frameValue = frameTimelineValue, .destroy = std::move(destroy) });
+}
+
+// Not overloaded, as non-dispatchable handles are all uint64_t on 32-bit platforms
+static void deferDestroyImage(VkImage image, VmaAllocation allocation) {
+	deferDeletion([=]() { vmaDestroyImage(allocator, image, allocation); });
+}
+
+static void deferDestroyImageView(VkImageView view) {
+	deferDeletion([=]() { vkDestroyImageView(device, view, nullptr); });
+}
+
+static void deferDestroySampler(VkSampler sampler) {
+	deferDeletion([=]() { vkDestroySampler(device, sampler, nullptr); });
+}
+
+// Sets must come from a pool created with VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT
+static void deferFreeDescriptorSet(VkDescriptorPool pool, VkDescriptorSet descriptorSet) {
+	deferDeletion([=]() { vkFreeDescriptorSets(device, pool, 1, &descriptorSet); });
+}
+
+// Entries are queued in frame order, so this stops at the first one the GPU may still be using
+static void processDeletionQueue(uint64_t completedFrameValue) {
+	while (!deletionQueue.empty() && (deletionQueue.front().frameValue <= completedFrameValue)) {
+		deletionQueue.front().destroy();
+		deletionQueue.pop_front();
+	}
+}
+
+// Presents are processed in order, so once an image presented on the current swapchain has been acquired again, all presents of retired swapchains have finished too
+// Called after a successful acquire, the frame waits on the acquire, so its timeline value covers that
+static void releaseRetiredPresentResources() {
+	for (const auto& retired : retiredPresentResources) {
+		deferDeletion([=]() {
+			for (auto semaphore : retired.renderSemaphores) {
+				vkDestroySemaphore(device, semaphore, nullptr);
+			}
+			vkDestroySwapchainKHR(device, retired.swapchain, nullptr);
+		});
+	}
+	retiredPresentResources.clear();
+}
+
+// Creates the swapchain and everything that depends on its images and size, a current swapchain is passed as oldSwapchain and retired
+static void createSwapchain(VkSwapchainCreateInfoKHR& swapchainCI, VkImageCreateInfo& renderImageCI, VkExtent2D extent) {
+	if (swapchain != VK_NULL_HANDLE) {
+		for (auto view : swapchainImageViews) {
+			deferDestroyImageView(view);
+		}
+		deferDestroyImageView(renderImageView);
+		deferDestroyImage(renderImage, renderImageAllocation);
+		retiredPresentResources.push_back({ .swapchain = swapchain, .renderSemaphores = renderSemaphores });
+		if (retiredPresentResources.size() > maxRetiredSwapchains) {
+			chk(vkQueueWaitIdle(queue));
+			const auto& oldest{ retiredPresentResources.front() };
+			for (auto semaphore : oldest.renderSemaphores) {
+				vkDestroySemaphore(device, semaphore, nullptr);
+			}
+			vkDestroySwapchainKHR(device, oldest.swapchain, nullptr);
+			retiredPresentResources.erase(retiredPresentResources.begin());
+		}
+	}
+	swapchainCI.oldSwapchain = swapchain;
+	swapchainCI.imageExtent = extent;
+	renderImageCI.extent = { .width = extent.width, .height = extent.height, .depth = 1 };
+	uint32_t imageCount{ 0 };
+	if (options.headless) {
+		// Without a surface the resolve targets are plain images, one per frame in flight as no presentation engine holds on to them
+		imageCount = maxFramesInFlight;
+		swapchainImages.resize(imageCount);
+		offscreenImageAllocations.resize(imageCount);
+		VkImageCreateInfo offscreenImageCI{ renderImageCI };
+		offscreenImageCI.samples = VK_SAMPLE_COUNT_1_BIT;
+		offscreenImageCI.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+		VmaAllocationCreateInfo offscreenAllocCI{ .usage = VMA_MEMORY_USAGE_AUTO };
+		for (auto i = 0; i < imageCount; i++) {
+			chk(vmaCreateImage(allocator, &offscreenImageCI, &offscreenAllocCI, &swapchainImages[i], &offscreenImageAllocations[i], nullptr));
+		}
+	} else {
+		chk(vkCreateSwapchainKHR(device, &swapchainCI, nullptr, &swapchain));
+		vkGetSwapchainImagesKHR(device, swapchain, &imageCount, nullptr);
+		swapchainImages.resize(imageCount);
+		vkGetSwapchainImagesKHR(device, swapchain, &imageCount, swapchainImages.data());
+	}
+	swapchainImageViews.resize(imageCount);
+	VmaAllocationCreateInfo allocCI{ .flags = VMA_ALLOCATION_CREATE_DEDICATED_MEMORY_BIT, .usage = VMA_MEMORY_USAGE_AUTO, .priority = 1.0f };
+	chk(vmaCreateImage(allocator, &renderImageCI, &allocCI, &renderImage, &renderImageAllocation, nullptr));
+	VkImageViewCreateInfo viewCI{ .sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO, .image = renderImage, .viewType = VK_IMAGE_VIEW_TYPE_2D, .format = swapchainCI.imageFormat, .subresourceRange{.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT, .levelCount = 1, .layerCount = 1 } };
+	chk(vkCreateImageView(device, &viewCI, nullptr, &renderImageView));
+	for (auto i = 0; i < imageCount; i++) {
+		viewCI.image = swapchainImages[i];
+		chk(vkCreateImageView(device, &viewCI, nullptr, &swapchainImageViews[i]));
+	}
+	// Signaled for presentation, so one per image (and none without presentation)
+	VkSemaphoreCreateInfo semaphoreCI{ .sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO };
+	renderSemaphores.resize(options.headless ? 0 : imageCount);
+	for (auto& semaphore : renderSemaphores) {
+		chk(vkCreateSemaphore(device, &semaphoreCI, nullptr, &semaphore));
+	}
+	presentedImages.assign(imageCount, false);
+}
 
-int main()
+int main(int argc, char* argv[])
 {
+	for (int i = 1; i < argc; i++) {
+		const std::string_view arg{ argv[i] };
+		const bool hasValue{ (i + 1 < argc) && (argv[i + 1][0] != '-') };
+		if (arg == "--startup-report") {
+			options.startupReport = true;
+			if (hasValue) {
+				options.startupReportFile = argv[++i];
+			}
+		}
+		if (arg == "--startup-repeat" && hasValue) {
+			options.startupRepeat = std::max(1, atoi(argv[++i]));
+		}
+		if (arg == "--startup-run" && hasValue) {
+			options.startupRunFile = argv[++i];
+		}
+		if (arg == "--frames-in-flight" && hasValue) {
+			options.framesInFlight = (uint32_t)std::clamp(atoi(argv[++i]), 1, (int)maxSupportedFramesInFlight);
+		}
+		if (arg == "--latency-report") {
+			options.latencyReport = true;
+			if (hasValue) {
+				options.latencyReportFile = argv[++i];
+			}
+		}
+		if (arg == "--benchmark" && hasValue) {
+			options.benchmarkFrames = std::max(1, atoi(argv[++i]));
+		}
+		if (arg == "--gpu-times") {
+			options.gpuTimes = true;
+			if (hasValue) {
+				options.gpuTimesFile = argv[++i];
+			}
+		}
+		if (arg == "--draw-stats") {
+			options.drawStats = true;
+			if (hasValue) {
+				options.drawStatsFile = argv[++i];
+			}
+		}
+		if (arg == "--trace" && hasValue) {
+			options.traceFile = argv[++i];
+		}
+		if (arg == "--headless") {
+			options.headless = true;
+			if (hasValue) {
+				options.headlessFrames = std::max(1, atoi(argv[++i]));
+			}
+		}
+		if (arg == "--objects" && hasValue) {
+			options.objectCount = std::max(1, atoi(argv[++i]));
+		}
+		if (arg == "--latency-frames" && hasValue) {
+			options.latencyFrames = std::max(1, atoi(argv[++i]));
+		}
+		if (arg == "--latency-run" && hasValue) {
+			options.latencyRunFile = argv[++i];
+		}
+		if (arg == "--present-mode" && hasValue) {
+			options.presentModes = parsePresentModes(argv[++i]);
+		}
+		if (arg == "--late-latch") {
+			options.lateLatch = true;
+		}
+		if (arg == "--push-constants") {
+			options.pushConstants = true;
+		}
+		if (arg == "--frame-pacing") {
+			options.framePacing = true;
+		}
+		if (arg == "--fps-report") {
+			options.fpsReport = true;
+			if (hasValue) {
+				options.fpsReportFile = argv[++i];
+			}
+		}
+	}
+	if (options.startupReport && options.startupRepeat > 1) {
+		return runStartupRepetitions(argv[0], argc, argv);
+	}
+	if (options.latencyReport && (options.framesInFlight == 0)) {
+		return runLatencySweep(argv[0], argc, argv);
+	}
+	if (options.framesInFlight > 0) {
+		maxFramesInFlight = options.framesInFlight;
+	}
+	// Shader compilation and texture loading don't depend on Vulkan, so they run on worker threads while the device is set up
+	auto shaderTask{ std::async(std::launch::async, [] {
+		const auto phaseStart{ Clock::now() };
+		std::vector<slang::PreprocessorMacroDesc> macros;
+		if (options.pushConstants) {
+			macros.push_back({ .name = "USE_PUSH_CONSTANTS", .value = "1" });
+		}
+		auto spirv{ loadShaderSpirv("triangle", "assets/shader.slang", macros) };
+		recordStartupPhase("shader_load", phaseStart);
+		return spirv;
+	}) };
+	auto textureTask{ std::async(std::launch::async, [] { return loadTextureFile("assets/vulkan.ktx"); }) };
 	// Setup
-	auto window = sf::RenderWindow(sf::VideoMode({ 1280, 720u }), "Modern Vulkan Triangle");
+	auto phaseStart{ Clock::now() };
+	// Not even constructed in headless mode, as SFML windows set up a shared GL context, which needs a display
+	std::optional<sf::RenderWindow> window;
+	if (!options.headless) {
+		window.emplace(sf::VideoMode({ 1280, 720u }), "Modern Vulkan Triangle");
+		recordStartupPhase("window", phaseStart);
+	}
+	phaseStart = Clock::now();
 	volkInitialize();
-	// Initialize slang compiler
-	slang::createGlobalSession(slangGlobalSession.writeRef());
-	auto targets{ std::to_array<slang::TargetDesc>({ {.format{SLANG_SPIRV}, .profile{slangGlobalSession->findProfile("spirv_1_6")} } }) };
-	auto options{ std::to_array<slang::CompilerOptionEntry>({ { slang::CompilerOptionName::EmitSpirvDirectly, {slang::CompilerOptionValueKind::Int, 1} } }) };
-	slang::SessionDesc desc{ .targets{targets.data()}, .targetCount{SlangInt(targets.size())}, .defaultMatrixLayoutMode = SLANG_MATRIX_LAYOUT_COLUMN_MAJOR, .compilerOptionEntries{options.data()}, .compilerOptionEntryCount{uint32_t(options.size())} };
-	Slang::ComPtr<slang::ISession> slangSession;
-	slangGlobalSession->createSession(desc, slangSession.writeRef());
+	recordStartupPhase("volk_init", phaseStart);
 	// Instance
+	phaseStart = Clock::now();
 	VkApplicationInfo appInfo{ .sType = VK_STRUCTURE_TYPE_APPLICATION_INFO, .pApplicationName = "Modern Vulkan Triangle", .apiVersion = VK_API_VERSION_1_3 };
-	const std::vector<const char*> instanceExtensions{ VK_KHR_SURFACE_EXTENSION_NAME, VK_KHR_WIN32_SURFACE_EXTENSION_NAME, };
+	std::vector<const char*> instanceExtensions;
+	if (!options.headless) {
+		instanceExtensions.insert(instanceExtensions.end(), { VK_KHR_SURFACE_EXTENSION_NAME, VK_KHR_WIN32_SURFACE_EXTENSION_NAME });
+	}
 	VkInstanceCreateInfo instanceCI{
 		.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO,
 		.pApplicationInfo = &appInfo,
@@ -105,61 +1720,150 @@ int main()
 	};
 	chk(vkCreateInstance(&instanceCI, nullptr, &instance));
 	volkLoadInstance(instance);
+	recordStartupPhase("instance", phaseStart);
 	// Device
+	phaseStart = Clock::now();
 	uint32_t deviceCount{ 0 };
 	vkEnumeratePhysicalDevices(instance, &deviceCount, nullptr);
 	std::vector<VkPhysicalDevice> devices(deviceCount);
 	vkEnumeratePhysicalDevices(instance, &deviceCount, devices.data());
-	const uint32_t qf{ 0 };
-	const float qfpriorities{ 1.0f };
 	const uint32_t deviceIndex{ 0 };
-	VkDeviceQueueCreateInfo queueCI{ .sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO, .queueFamilyIndex = qf, .queueCount = 1, .pQueuePriorities = &qfpriorities };
-	VkPhysicalDeviceVulkan13Features features{ .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES, .dynamicRendering = true };
-	const std::vector<const char*> deviceExtensions{ VK_KHR_SWAPCHAIN_EXTENSION_NAME };
-	const VkPhysicalDeviceFeatures enabledFeatures{ .samplerAnisotropy = VK_TRUE };
+	physicalDevice = devices[deviceIndex];
+	// Graphics queue, plus a transfer-only queue (usually backed by a dedicated DMA engine) for uploads if the device has one
+	uint32_t queueFamilyCount{ 0 };
+	vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, nullptr);
+	std::vector<VkQueueFamilyProperties> queueFamilyProps(queueFamilyCount);
+	vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, queueFamilyProps.data());
+	queueFamily = UINT32_MAX;
+	uploadQueueFamily = UINT32_MAX;
+	for (uint32_t i = 0; i < queueFamilyCount; i++) {
+		const VkQueueFlags flags{ queueFamilyProps[i].queueFlags };
+		if ((flags & VK_QUEUE_GRAPHICS_BIT) && (queueFamily == UINT32_MAX)) {
+			queueFamily = i;
+		}
+		if ((flags & VK_QUEUE_TRANSFER_BIT) && !(flags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT)) && (uploadQueueFamily == UINT32_MAX)) {
+			uploadQueueFamily = i;
+		}
+	}
+	chk(queueFamily != UINT32_MAX);
+	if (uploadQueueFamily == UINT32_MAX) {
+		uploadQueueFamily = queueFamily;
+	}
+	const float qfpriorities{ 1.0f };
+	std::vector<VkDeviceQueueCreateInfo> queueCIs{ {.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO, .queueFamilyIndex = queueFamily, .queueCount = 1, .pQueuePriorities = &qfpriorities } };
+	if (uploadQueueFamily != queueFamily) {
+		queueCIs.push_back({ .sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO, .queueFamilyIndex = uploadQueueFamily, .queueCount = 1, .pQueuePriorities = &qfpriorities });
+	}
+	VkPhysicalDeviceVulkan12Features features12{ .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES, .timelineSemaphore = true };
+	VkPhysicalDeviceVulkan13Features features{ .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES, .pNext = &features12, .dynamicRendering = true };
+	std::vector<const char*> deviceExtensions;
+	if (!options.headless) {
+		deviceExtensions.push_back(VK_KHR_SWAPCHAIN_EXTENSION_NAME);
+	}
+	// Frame pacing needs present ids and waiting for them
+	uint32_t extensionCount{ 0 };
+	vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &extensionCount, nullptr);
+	std::vector<VkExtensionProperties> extensionProps(extensionCount);
+	vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &extensionCount, extensionProps.data());
+	auto hasExtension = [&extensionProps](std::string_view name) { return std::any_of(extensionProps.begin(), extensionProps.end(), [name](const auto& props) { return name == props.extensionName; }); };
+	VkPhysicalDevicePresentWaitFeaturesKHR presentWaitFeatures{ .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_WAIT_FEATURES_KHR };
+	VkPhysicalDevicePresentIdFeaturesKHR presentIdFeatures{ .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_ID_FEATURES_KHR, .pNext = &presentWaitFeatures };
+	if (options.framePacing && !options.headless && hasExtension(VK_KHR_PRESENT_ID_EXTENSION_NAME) && hasExtension(VK_KHR_PRESENT_WAIT_EXTENSION_NAME)) {
+		VkPhysicalDeviceFeatures2 supportedFeatures2{ .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2, .pNext = &presentIdFeatures };
+		vkGetPhysicalDeviceFeatures2(physicalDevice, &supportedFeatures2);
+	}
+	const bool presentWait{ presentIdFeatures.presentId && presentWaitFeatures.presentWait };
+	if (presentWait) {
+		deviceExtensions.insert(deviceExtensions.end(), { VK_KHR_PRESENT_ID_EXTENSION_NAME, VK_KHR_PRESENT_WAIT_EXTENSION_NAME });
+		features12.pNext = &presentIdFeatures;
+	} else if (options.framePacing) {
+		std::cerr << "Frame pacing requires VK_KHR_present_id and VK_KHR_present_wait, which this device doesn't support\n";
+	}
+	// GPU zones are placed on the CPU timeline of the trace with calibrated timestamps if possible, otherwise the offset is estimated
+	bool calibratedTimestamps{ false };
+	if (!options.traceFile.empty() && hasExtension(VK_EXT_CALIBRATED_TIMESTAMPS_EXTENSION_NAME)) {
+		uint32_t timeDomainCount{ 0 };
+		vkGetPhysicalDeviceCalibrateableTimeDomainsEXT(physicalDevice, &timeDomainCount, nullptr);
+		std::vector<VkTimeDomainEXT> timeDomains(timeDomainCount);
+		vkGetPhysicalDeviceCalibrateableTimeDomainsEXT(physicalDevice, &timeDomainCount, timeDomains.data());
+		auto hasTimeDomain = [&timeDomains](VkTimeDomainEXT domain) { return std::find(timeDomains.begin(), timeDomains.end(), domain) != timeDomains.end(); };
+		calibratedTimestamps = hasTimeDomain(VK_TIME_DOMAIN_DEVICE_EXT) && hasTimeDomain(hostTimeDomain);
+		if (calibratedTimestamps) {
+			deviceExtensions.push_back(VK_EXT_CALIBRATED_TIMESTAMPS_EXTENSION_NAME);
+		}
+	}
+	// Block compressed texture formats can only be used if their feature is enabled
+	VkPhysicalDeviceFeatures supportedFeatures{};
+	vkGetPhysicalDeviceFeatures(physicalDevice, &supportedFeatures);
+	if (options.drawStats && !supportedFeatures.pipelineStatisticsQuery) {
+		std::cerr << "Draw statistics require pipeline statistics queries, which this device doesn't support\n";
+		options.drawStats = false;
+	}
+	const VkPhysicalDeviceFeatures enabledFeatures{
+		.samplerAnisotropy = VK_TRUE,
+		.textureCompressionETC2 = supportedFeatures.textureCompressionETC2,
+		.textureCompressionASTC_LDR = supportedFeatures.textureCompressionASTC_LDR,
+		.textureCompressionBC = supportedFeatures.textureCompressionBC,
+		.occlusionQueryPrecise = options.drawStats ? supportedFeatures.occlusionQueryPrecise : VK_FALSE,
+		.pipelineStatisticsQuery = options.drawStats ? VK_TRUE : VK_FALSE
+	};
 	VkDeviceCreateInfo deviceCI{
 		.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO,
 		.pNext = &features,
-		.queueCreateInfoCount = 1,
-		.pQueueCreateInfos = &queueCI,
+		.queueCreateInfoCount = static_cast<uint32_t>(queueCIs.size()),
+		.pQueueCreateInfos = queueCIs.data(),
 		.enabledExtensionCount = static_cast<uint32_t>(deviceExtensions.size()),
 		.ppEnabledExtensionNames = deviceExtensions.data(),
 		.pEnabledFeatures = &enabledFeatures
 	};
-	chk(vkCreateDevice(devices[deviceIndex], &deviceCI, nullptr, &device));
-	vkGetDeviceQueue(device, qf, 0, &queue);
+	chk(vkCreateDevice(physicalDevice, &deviceCI, nullptr, &device));
+	vkGetDeviceQueue(device, queueFamily, 0, &queue);
+	vkGetDeviceQueue(device, uploadQueueFamily, 0, &uploadQueue);
+	recordStartupPhase("device", phaseStart);
 	// VMA
+	phaseStart = Clock::now();
 	VmaVulkanFunctions vkFunctions{ .vkGetInstanceProcAddr = vkGetInstanceProcAddr, .vkGetDeviceProcAddr = vkGetDeviceProcAddr, .vkCreateImage = vkCreateImage };
-	VmaAllocatorCreateInfo allocatorCI{ .physicalDevice = devices[deviceIndex], .device = device, .pVulkanFunctions = &vkFunctions, .instance = instance };
+	VmaAllocatorCreateInfo allocatorCI{ .physicalDevice = physicalDevice, .device = device, .pVulkanFunctions = &vkFunctions, .instance = instance };
 	chk(vmaCreateAllocator(&allocatorCI, &allocator));
+	recordStartupPhase("vma_allocator", phaseStart);
+	// Pipeline cache (persisted across runs)
+	phaseStart = Clock::now();
+	VkPhysicalDeviceProperties deviceProps{};
+	vkGetPhysicalDeviceProperties(physicalDevice, &deviceProps);
+	const std::vector<char> pipelineCacheData{ loadPipelineCacheData(deviceProps) };
+	VkPipelineCacheCreateInfo pipelineCacheCI{ .sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO, .initialDataSize = pipelineCacheData.size(), .pInitialData = pipelineCacheData.data() };
+	chk(vkCreatePipelineCache(device, &pipelineCacheCI, nullptr, &pipelineCache));
+	recordStartupPhase("pipeline_cache_load", phaseStart);
 	// Presentation
-	chk(window.createVulkanSurface(instance, surface));
+	phaseStart = Clock::now();
 	const VkFormat imageFormat{ VK_FORMAT_B8G8R8A8_SRGB };
+	VkSurfaceCapabilitiesKHR surfaceCaps{};
+	VkPresentModeKHR presentMode{ VK_PRESENT_MODE_FIFO_KHR };
+	VkExtent2D imageExtent{ .width = 1280, .height = 720 };
+	if (!options.headless) {
+		chk(window->createVulkanSurface(instance, surface));
+		chk(vkGetPhysicalDeviceSurfaceCapabilitiesKHR(physicalDevice, surface, &surfaceCaps));
+		presentMode = selectPresentMode(options.presentModes);
+		imageExtent = { .width = window->getSize().x, .height = window->getSize().y };
+	}
+	// Only the format and extent are used in headless mode
 	VkSwapchainCreateInfoKHR swapchainCI{
 		.sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR,
 		.surface = surface,
-		.minImageCount = 2,
+		.minImageCount = options.headless ? 0u : selectImageCount(surfaceCaps, presentMode),
 		.imageFormat = imageFormat,
 		.imageColorSpace = VK_COLORSPACE_SRGB_NONLINEAR_KHR,
-		.imageExtent{ .width = window.getSize().x, .height = window.getSize().y, },
+		.imageExtent = imageExtent,
 		.imageArrayLayers = 1,
 		.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT,
-		.queueFamilyIndexCount = qf,
-		.preTransform = VK_SURFACE_TRANSFORM_IDENTITY_BIT_KHR,
+		.preTransform = options.headless ? VK_SURFACE_TRANSFORM_IDENTITY_BIT_KHR : surfaceCaps.currentTransform,
 		.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR,
-		.presentMode = VK_PRESENT_MODE_FIFO_KHR
+		.presentMode = presentMode
 	};
-	chk(vkCreateSwapchainKHR(device, &swapchainCI, nullptr, &swapchain));
-	uint32_t imageCount{ 0 };
-	vkGetSwapchainImagesKHR(device, swapchain, &imageCount, nullptr);
-	swapchainImages.resize(imageCount);
-	vkGetSwapchainImagesKHR(device, swapchain, &imageCount, swapchainImages.data());
-	swapchainImageViews.resize(imageCount);
 	VkImageCreateInfo renderImageCI{
 		.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
 		.imageType = VK_IMAGE_TYPE_2D,
 		.format = imageFormat,
-		.extent{.width = window.getSize().x, .height = window.getSize().y, .depth = 1 },
 		.mipLevels = 1,
 		.arrayLayers = 1,
 		.samples = sampleCount,
@@ -167,165 +1871,152 @@ int main()
 		.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
 		.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
 	};
-	VmaAllocationCreateInfo allocCI{ .flags = VMA_ALLOCATION_CREATE_DEDICATED_MEMORY_BIT, .usage = VMA_MEMORY_USAGE_AUTO, .priority = 1.0f };
-	vmaCreateImage(allocator, &renderImageCI, &allocCI, &renderImage, &renderImageAllocation, nullptr);
-	VkImageViewCreateInfo viewCI{ .sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO, .image = renderImage, .viewType = VK_IMAGE_VIEW_TYPE_2D, .format = imageFormat, .subresourceRange{.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT, .levelCount = 1, .layerCount = 1 } };
-	chk(vkCreateImageView(device, &viewCI, nullptr, &renderImageView));
-	for (auto i = 0; i < imageCount; i++) {
-		viewCI.image = swapchainImages[i];
-		chk(vkCreateImageView(device, &viewCI, nullptr, &swapchainImageViews[i]));
-	}
+	createSwapchain(swapchainCI, renderImageCI, swapchainCI.imageExtent);
+	recordStartupPhase("swapchain", phaseStart);
 	// Vertex (Pos 3f, UV 2f) and index buffers
+	phaseStart = Clock::now();
 	const std::vector<float> vertices{ 1.0f, 1.0f, 0.0f, 1.0f, 1.0f, /**/ -1.0f, 1.0f, 0.0f, 0.0f, 1.0f /**/, -1.0f, -1.0f, 0.0f, 0.0f, 0.0f /**/, 1.0f, -1.0f, 0.0f, 1.0f, 0.0f };;
 	std::vector<uint16_t> indices = { 0, 1, 2, /**/ 2, 3, 0 };
 	VkDeviceSize vBufSize{ sizeof(float) * vertices.size() }; VkDeviceSize iBufSize{ sizeof(uint16_t) * indices.size() };
-	VkBufferCreateInfo bufferCI{ .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO, .size = vBufSize + iBufSize, .usage = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT};
-	VmaAllocationCreateInfo bufferAllocCI{ .flags = VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT | VMA_ALLOCATION_CREATE_HOST_ACCESS_ALLOW_TRANSFER_INSTEAD_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT, .usage = VMA_MEMORY_USAGE_AUTO };
-	chk(vmaCreateBuffer(allocator, &bufferCI, &bufferAllocCI, &vBuffer, &vBufferAllocation, nullptr));
-	void* bufferPtr{ nullptr };
-	vmaMapMemory(allocator, vBufferAllocation, &bufferPtr);
-	memcpy(bufferPtr, vertices.data(), vBufSize);
-	memcpy(((char*)bufferPtr) + vBufSize, indices.data(), iBufSize);
-	vmaUnmapMemory(allocator, vBufferAllocation);
-	VkCommandPoolCreateInfo commandPoolCI{ .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO, .flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT, .queueFamilyIndex = qf };
+	VkCommandPoolCreateInfo commandPoolCI{ .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO, .flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT, .queueFamilyIndex = queueFamily };
 	chk(vkCreateCommandPool(device, &commandPoolCI, nullptr, &commandPool));
+	VkCommandPoolCreateInfo uploadCommandPoolCI{ .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO, .flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT, .queueFamilyIndex = uploadQueueFamily };
+	chk(vkCreateCommandPool(device, &uploadCommandPoolCI, nullptr, &uploadCommandPool));
+	// Startup uploads go through the staging ring and are submitted to the upload queue, which the frames wait for on the GPU
+	stagingRingCreate(stagingRingSize);
+	VkSemaphoreTypeCreateInfo uploadTimelineTypeCI{ .sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO, .semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE };
+	VkSemaphoreCreateInfo uploadTimelineCI{ .sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO, .pNext = &uploadTimelineTypeCI };
+	chk(vkCreateSemaphore(device, &uploadTimelineCI, nullptr, &uploadTimeline));
+	VkCommandBuffer cbUpload{ beginUpload() };
+	// Resources written by the upload queue and only read by the graphics queue are shared concurrently, which saves an ownership transfer
+	const uint32_t uploadQueueFamilies[2]{ queueFamily, uploadQueueFamily };
+	const VkSharingMode uploadSharingMode{ (uploadQueueFamily != queueFamily) ? VK_SHARING_MODE_CONCURRENT : VK_SHARING_MODE_EXCLUSIVE };
+	VkBufferCreateInfo bufferCI{ .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO, .size = vBufSize + iBufSize, .usage = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, .sharingMode = uploadSharingMode, .queueFamilyIndexCount = 2, .pQueueFamilyIndices = uploadQueueFamilies };
+	VmaAllocationCreateInfo bufferAllocCI{ .usage = VMA_MEMORY_USAGE_AUTO };
+	chk(vmaCreateBuffer(allocator, &bufferCI, &bufferAllocCI, &vBuffer, &vBufferAllocation, nullptr));
+	const StagingBlock vStaging{ stagingRingAlloc(vBufSize + iBufSize, 4) };
+	memcpy(vStaging.data, vertices.data(), vBufSize);
+	memcpy(vStaging.data + vBufSize, indices.data(), iBufSize);
+	VkBufferCopy vBufferCopy{ .srcOffset = vStaging.offset, .size = vBufSize + iBufSize };
+	vkCmdCopyBuffer(cbUpload, vStaging.buffer, vBuffer, 1, &vBufferCopy);
 	// Descriptor pool
-	VkDescriptorPoolSize poolSizes[2]{ { .type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, .descriptorCount = maxFramesInFlight }, {.type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, .descriptorCount = 1 } };
-	VkDescriptorPoolCreateInfo descPoolCI{ .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO, .maxSets = maxFramesInFlight + 1, .poolSizeCount = 2, .pPoolSizes = poolSizes  };
+	VkDescriptorPoolSize poolSizes[2]{ { .type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, .descriptorCount = 1 }, {.type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, .descriptorCount = 2 } };
+	VkDescriptorPoolCreateInfo descPoolCI{ .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO, .flags = VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT, .maxSets = 3, .poolSizeCount = 2, .pPoolSizes = poolSizes  };
 	chk(vkCreateDescriptorPool(device, &descPoolCI, nullptr, &descriptorPool));
 	// Uniform buffers
-	VkDescriptorSetLayoutBinding descLayoutBinding{.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, .descriptorCount = 1, .stageFlags = VK_SHADER_STAGE_VERTEX_BIT};
+	VkDescriptorSetLayoutBinding descLayoutBinding{.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, .descriptorCount = 1, .stageFlags = VK_SHADER_STAGE_VERTEX_BIT};
 	VkDescriptorSetLayoutCreateInfo descLayoutCI{ .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO, .bindingCount = 1,  .pBindings = &descLayoutBinding };
 	chk(vkCreateDescriptorSetLayout(device, &descLayoutCI, nullptr, &descriptorSetLayout));
-	for (auto i = 0; i < maxFramesInFlight; i++) {
-		VkBufferCreateInfo uBufferCI{ .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO, .size = sizeof(glm::mat4), .usage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT };
-		VmaAllocationCreateInfo uBufferAllocCI{ .flags = VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT | VMA_ALLOCATION_CREATE_HOST_ACCESS_ALLOW_TRANSFER_INSTEAD_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT, .usage = VMA_MEMORY_USAGE_AUTO };
-		chk(vmaCreateBuffer(allocator, &uBufferCI, &uBufferAllocCI, &uniformBuffers[i].buffer, &uniformBuffers[i].allocation, nullptr));
-		vmaMapMemory(allocator, uniformBuffers[i].allocation, &uniformBuffers[i].mapped);
+	// Not needed at all if the matrices are pushed
+	if (!options.pushConstants) {
+		const VkDeviceSize uniformAlignment{ std::max<VkDeviceSize>(deviceProps.limits.minUniformBufferOffsetAlignment, 1) };
+		const VkDeviceSize uniformStride{ (sizeof(glm::mat4) + uniformAlignment - 1) / uniformAlignment * uniformAlignment };
+		uniformRingCreate(uniformStride * options.objectCount, uniformAlignment);
 		VkDescriptorSetAllocateInfo allocInfo{ .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO, .descriptorPool = descriptorPool, .descriptorSetCount = 1, .pSetLayouts = &descriptorSetLayout };
-		chk(vkAllocateDescriptorSets(device, &allocInfo, &uniformBuffers[i].descriptorSet));
-		VkDescriptorBufferInfo descBuffInfo{ .buffer = uniformBuffers[i].buffer, .range = VK_WHOLE_SIZE };
-		VkWriteDescriptorSet writeDescSet{ .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET, .dstSet = uniformBuffers[i].descriptorSet, .dstBinding = 0, .descriptorCount = 1, .descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, .pBufferInfo = &descBuffInfo, };
+		chk(vkAllocateDescriptorSets(device, &allocInfo, &uniformRing.descriptorSet));
+		// The range is what a single draw sees, the dynamic offset selects where it starts
+		VkDescriptorBufferInfo descBuffInfo{ .buffer = uniformRing.buffer, .range = sizeof(glm::mat4) };
+		VkWriteDescriptorSet writeDescSet{ .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET, .dstSet = uniformRing.descriptorSet, .dstBinding = 0, .descriptorCount = 1, .descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, .pBufferInfo = &descBuffInfo, };
 		vkUpdateDescriptorSets(device, 1, &writeDescSet, 0, nullptr);
 	}
 	// Sync objects
+	VkSemaphoreTypeCreateInfo frameTimelineTypeCI{ .sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO, .semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE };
+	VkSemaphoreCreateInfo frameTimelineCI{ .sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO, .pNext = &frameTimelineTypeCI };
+	chk(vkCreateSemaphore(device, &frameTimelineCI, nullptr, &frameTimeline));
+	// Swapchain acquire and present only work with binary semaphores
 	VkSemaphoreCreateInfo semaphoreCI{ .sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO };
+	commandBuffers.resize(maxFramesInFlight);
+	presentSemaphores.resize(maxFramesInFlight);
 	for (auto i = 0; i < maxFramesInFlight; i++) {
 		VkCommandBufferAllocateInfo cbAllocCI{ .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO, .commandPool = commandPool, .commandBufferCount = 1};
 		chk(vkAllocateCommandBuffers(device, &cbAllocCI, &commandBuffers[i]));
-		VkFenceCreateInfo fenceCI{ .sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO, .flags = VK_FENCE_CREATE_SIGNALED_BIT};
-		vkCreateFence(device, &fenceCI, nullptr, &fences[i]);
 		chk(vkCreateSemaphore(device, &semaphoreCI, nullptr, &presentSemaphores[i]));
 	}
-	renderSemaphores.resize(swapchainImages.size());
-	for (auto& semaphore : renderSemaphores) {
-		chk(vkCreateSemaphore(device, &semaphoreCI, nullptr, &semaphore));
+	// Timestamp queries, also needed for the GPU zones of the trace
+	if (options.gpuTimes || !options.traceFile.empty()) {
+		if (queueFamilyProps[queueFamily].timestampValidBits > 0) {
+			gpuTimerCreate(deviceProps.limits.timestampPeriod, queueFamilyProps[queueFamily].timestampValidBits, calibratedTimestamps);
+		} else {
+			std::cerr << "GPU times require timestamp support on the graphics queue, which this device doesn't have\n";
+			options.gpuTimes = false;
+		}
 	}
-	// Image
-	std::ifstream ktxFile("assets/vulkan.ktx", std::ios::binary | std::ios::ate);
-	assert(ktxFile.is_open());
-	size_t ktxSize = ktxFile.tellg();
-	ktxFile.seekg(std::ios::beg);
-	char* ktxData = new char[ktxSize];
-	ktxFile.read(ktxData, ktxSize);
-	ddsktx_texture_info tc = { 0 };
-	ddsktx_parse(&tc, ktxData, ktxSize, nullptr);
-	VmaAllocationCreateInfo uImageAllocCI{ .flags = VMA_ALLOCATION_CREATE_DEDICATED_MEMORY_BIT, .usage = VMA_MEMORY_USAGE_AUTO, .priority = 1.0f };
-	VkImageCreateInfo texImgCI{
+	if (options.drawStats) {
+		drawStatsCreate(enabledFeatures.occlusionQueryPrecise);
+	}
+	recordStartupPhase("buffers_and_sync", phaseStart);
+	// Texture, the real one is streamed in from the render loop, so until then a placeholder is used
+	phaseStart = Clock::now();
+	VkDescriptorSetLayoutBinding descLayoutBindingTex{ .descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, .descriptorCount = 1, .stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT };
+	VkDescriptorSetLayoutCreateInfo descLayoutTexCI{ .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO, .bindingCount = 1,  .pBindings = &descLayoutBindingTex };
+	chk(vkCreateDescriptorSetLayout(device, &descLayoutTexCI, nullptr, &descriptorSetLayoutTex));
+	VkImageCreateInfo placeholderImgCI{
 		.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
 		.imageType = VK_IMAGE_TYPE_2D,
-		.format = VK_FORMAT_R8G8B8A8_SRGB,
-		.extent = {.width = (uint32_t)tc.width, .height = (uint32_t)tc.height, .depth = 1 },
-		.mipLevels = (uint32_t)tc.num_mips,
+		.format = VK_FORMAT_R8G8B8A8_UNORM,
+		.extent = {.width = 1, .height = 1, .depth = 1 },
+		.mipLevels = 1,
 		.arrayLayers = 1,
 		.samples = VK_SAMPLE_COUNT_1_BIT,
 		.tiling = VK_IMAGE_TILING_OPTIMAL,
 		.usage = VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+		.sharingMode = uploadSharingMode,
+		.queueFamilyIndexCount = 2,
+		.pQueueFamilyIndices = uploadQueueFamilies,
 		.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED
 	};
-	chk(vmaCreateImage(allocator, &texImgCI, &uImageAllocCI, &texture.image, &texture.allocation, nullptr));
-	VkImageViewCreateInfo texVewCI{ .sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO, .image = texture.image, .viewType = VK_IMAGE_VIEW_TYPE_2D, .format = texImgCI.format, .subresourceRange = {.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT, .levelCount = 1, .layerCount = 1 } };
-	chk(vkCreateImageView(device, &texVewCI, nullptr, &texture.view));
-	VkDescriptorSetLayoutBinding descLayoutBindingTex{ .descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, .descriptorCount = 1, .stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT };
-	VkDescriptorSetLayoutCreateInfo descLayoutTexCI{ .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO, .bindingCount = 1,  .pBindings = &descLayoutBindingTex };
-	chk(vkCreateDescriptorSetLayout(device, &descLayoutTexCI, nullptr, &descriptorSetLayoutTex));
-	VkDescriptorSetAllocateInfo texDescSetAlloc{ .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO, .descriptorPool = descriptorPool, .descriptorSetCount = 1, .pSetLayouts = &descriptorSetLayoutTex };
-	chk(vkAllocateDescriptorSets(device, &texDescSetAlloc, &texture.descriptorSet));
-	// Sampler
-	VkSamplerCreateInfo samplerCI{
-		.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO,
-		.magFilter = VK_FILTER_LINEAR,
-		.minFilter = VK_FILTER_LINEAR,
-		.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR,
-		.anisotropyEnable = VK_TRUE,
-		.maxAnisotropy = 8.0f,
-		.maxLod = (float)texImgCI.mipLevels,
-	};
-	chk(vkCreateSampler(device, &samplerCI, nullptr, &texture.sampler));
-	VkDescriptorImageInfo descTexInfo{ .sampler = texture.sampler, .imageView = texture.view, .imageLayout = VK_IMAGE_LAYOUT_READ_ONLY_OPTIMAL_KHR };
-	VkWriteDescriptorSet writeDescSet{ .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET, .dstSet = texture.descriptorSet, .dstBinding = 0, .descriptorCount = 1, .descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, .pImageInfo = &descTexInfo };
-	vkUpdateDescriptorSets(device, 1, &writeDescSet, 0, nullptr);
-	// Copy (first mip only)
-	ddsktx_sub_data subData;
-	ddsktx_get_sub(&tc, &subData, ktxData, ktxSize, 0, 0, 0);
-	VkBuffer stagingBuffer{};
-	VmaAllocation stagingAllocation{};
-	VkBufferCreateInfo stgBufferCI{ .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO, .size = (uint32_t)subData.size_bytes, .usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT };
-	VmaAllocationCreateInfo stgAllocCI{ .flags = VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT, .usage = VMA_MEMORY_USAGE_AUTO };
-	chk(vmaCreateBuffer(allocator, &stgBufferCI, &stgAllocCI, &stagingBuffer, &stagingAllocation, nullptr));
-	void* stagingPtr{ nullptr };
-	vmaMapMemory(allocator, stagingAllocation, &stagingPtr);
-	memcpy(stagingPtr, subData.buff, subData.size_bytes);
-	VkFenceCreateInfo fenceOneTimeCI{ .sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO };
-	VkFence fenceOneTime{};
-	chk(vkCreateFence(device, &fenceOneTimeCI, nullptr, &fenceOneTime));
-	VkCommandBuffer cbOneTime{};
-	VkCommandBufferAllocateInfo cbOneTimeAI{ .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO, .commandPool = commandPool, .commandBufferCount = 1 };
-	chk(vkAllocateCommandBuffers(device, &cbOneTimeAI, &cbOneTime));
-	VkCommandBufferBeginInfo cbOneTimeBI{ .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO, .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT, };
-	vkBeginCommandBuffer(cbOneTime, &cbOneTimeBI);
-	VkImageMemoryBarrier barrierTex0{
+	VmaAllocationCreateInfo placeholderAllocCI{ .usage = VMA_MEMORY_USAGE_AUTO };
+	chk(vmaCreateImage(allocator, &placeholderImgCI, &placeholderAllocCI, &placeholderTexture.image, &placeholderTexture.allocation, nullptr));
+	VkImageViewCreateInfo placeholderViewCI{ .sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO, .image = placeholderTexture.image, .viewType = VK_IMAGE_VIEW_TYPE_2D, .format = placeholderImgCI.format, .subresourceRange = {.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT, .levelCount = 1, .layerCount = 1 } };
+	chk(vkCreateImageView(device, &placeholderViewCI, nullptr, &placeholderTexture.view));
+	VkSamplerCreateInfo placeholderSamplerCI{ .sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO };
+	chk(vkCreateSampler(device, &placeholderSamplerCI, nullptr, &placeholderTexture.sampler));
+	VkDescriptorSetAllocateInfo placeholderDescSetAlloc{ .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO, .descriptorPool = descriptorPool, .descriptorSetCount = 1, .pSetLayouts = &descriptorSetLayoutTex };
+	chk(vkAllocateDescriptorSets(device, &placeholderDescSetAlloc, &placeholderTexture.descriptorSet));
+	VkDescriptorImageInfo placeholderDescInfo{ .sampler = placeholderTexture.sampler, .imageView = placeholderTexture.view, .imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL };
+	VkWriteDescriptorSet placeholderWriteDescSet{ .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET, .dstSet = placeholderTexture.descriptorSet, .dstBinding = 0, .descriptorCount = 1, .descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, .pImageInfo = &placeholderDescInfo };
+	vkUpdateDescriptorSets(device, 1, &placeholderWriteDescSet, 0, nullptr);
+	const uint32_t placeholderTexel{ 0xFFFFFFFF };
+	const StagingBlock placeholderStaging{ stagingRingAlloc(sizeof(placeholderTexel), 4) };
+	memcpy(placeholderStaging.data, &placeholderTexel, sizeof(placeholderTexel));
+	VkImageMemoryBarrier placeholderBarrier{
 		.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
 		.srcAccessMask = 0,
 		.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
 		.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED,
 		.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-		.image = texture.image,
+		// Concurrently shared with a dedicated transfer family, which (without synchronization2) requires ignored queue families
+		.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+		.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+		.image = placeholderTexture.image,
 		.subresourceRange = {.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT, .levelCount = 1, .layerCount = 1 }
 	};
-	vkCmdPipelineBarrier(cbOneTime, VK_PIPELINE_STAGE_HOST_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrierTex0);
-	VkBufferImageCopy copyRegion{
-		.imageSubresource{.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT, .mipLevel = 0, .layerCount = 1 },
-		.imageExtent{.width = (uint32_t)tc.width, .height = (uint32_t)tc.height, .depth = 1 },
-	};
-	vkCmdCopyBufferToImage(cbOneTime, stagingBuffer, texture.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &copyRegion);
-	VkImageMemoryBarrier barrierTex1{
-		.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
-		.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
-		.dstAccessMask = VK_ACCESS_SHADER_READ_BIT,
-		.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-		.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
-		.image = texture.image,
-		.subresourceRange = {.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT, .levelCount = 1, .layerCount = 1 }
-	};
-	vkCmdPipelineBarrier(cbOneTime, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrierTex1);
-	vkEndCommandBuffer(cbOneTime);
-	VkSubmitInfo oneTimeSI{ .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO, .commandBufferCount = 1, .pCommandBuffers = &cbOneTime };
-	chk(vkQueueSubmit(queue, 1, &oneTimeSI, fenceOneTime));
-	chk(vkWaitForFences(device, 1, &fenceOneTime, VK_TRUE, UINT64_MAX));
-	vmaUnmapMemory(allocator, stagingAllocation);
-	vmaDestroyBuffer(allocator, stagingBuffer, stagingAllocation);
-	delete[] ktxData;
+	vkCmdPipelineBarrier(cbUpload, VK_PIPELINE_STAGE_HOST_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &placeholderBarrier);
+	VkBufferImageCopy placeholderCopy{ .bufferOffset = placeholderStaging.offset, .imageSubresource{.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT, .layerCount = 1 }, .imageExtent{.width = 1, .height = 1, .depth = 1 } };
+	vkCmdCopyBufferToImage(cbUpload, placeholderStaging.buffer, placeholderTexture.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &placeholderCopy);
+	// Transfer queues don't support the fragment stage, visibility for the fragment shader comes from the frame's semaphore wait
+	placeholderBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	placeholderBarrier.dstAccessMask = 0;
+	placeholderBarrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+	placeholderBarrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	vkCmdPipelineBarrier(cbUpload, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr, 0, nullptr, 1, &placeholderBarrier);
+	// Frames wait for this value on the GPU, so nothing blocks here
+	const uint64_t geometryUploadValue{ submitUpload(cbUpload) };
+	recordStartupPhase("placeholder_texture", phaseStart);
 	// Shaders
-	Slang::ComPtr<slang::IModule> slangModule{ slangSession->loadModuleFromSource("triangle", "assets/shader.slang", nullptr, nullptr) };
-	Slang::ComPtr<ISlangBlob> spirv;
-	slangModule->getTargetCode(0, spirv.writeRef());
-	VkShaderModuleCreateInfo shaderModuleCI{ .sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO, .codeSize = spirv->getBufferSize(), .pCode = (uint32_t*)spirv->getBufferPointer() };
+	phaseStart = Clock::now();
+	const std::vector<uint32_t> spirv{ shaderTask.get() };
+	recordStartupPhase("shader_wait", phaseStart);
+	phaseStart = Clock::now();
+	VkShaderModuleCreateInfo shaderModuleCI{ .sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO, .codeSize = spirv.size() * sizeof(uint32_t), .pCode = spirv.data() };
 	VkShaderModule shaderModule{};
 	vkCreateShaderModule(device, &shaderModuleCI, nullptr, &shaderModule);
+	recordStartupPhase("shader_module", phaseStart);
 	// Pipeline
+	phaseStart = Clock::now();
 	VkDescriptorSetLayout pipelineSetLayouts[2]{ descriptorSetLayout, descriptorSetLayoutTex };
-	VkPipelineLayoutCreateInfo pipelineLayoutCI{ .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO, .setLayoutCount = 2, .pSetLayouts = pipelineSetLayouts };
+	VkPushConstantRange mvpPushConstRange{ .stageFlags = VK_SHADER_STAGE_VERTEX_BIT, .size = sizeof(glm::mat4) };
+	VkPipelineLayoutCreateInfo pipelineLayoutCI{ .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO, .setLayoutCount = 2, .pSetLayouts = pipelineSetLayouts, .pushConstantRangeCount = options.pushConstants ? 1u : 0u, .pPushConstantRanges = &mvpPushConstRange };
 	chk(vkCreatePipelineLayout(device, &pipelineLayoutCI, nullptr, &pipelineLayout));
 	std::vector<VkPipelineShaderStageCreateInfo> stages{
 		{.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO, .stage = VK_SHADER_STAGE_VERTEX_BIT, .module = shaderModule, .pName = "main"},
@@ -368,26 +2059,254 @@ int main()
 		.pDynamicState = &dynamicState,
 		.layout = pipelineLayout
 	};
-	chk(vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &pipelineCI, nullptr, &pipeline));
+	chk(vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineCI, nullptr, &pipeline));
 	vkDestroyShaderModule(device, shaderModule, nullptr);
+	recordStartupPhase("pipeline_creation", phaseStart);
 	// Render loop
+	bool firstFrame{ true };
+	bool startupReported{ false };
 	sf::Clock clock;
-	while (window.isOpen()) {
+	Clock::time_point inputTime{ Clock::now() };
+	// Frame rate, shown in the window title once per second and optionally reported for the whole run
+	const Clock::time_point fpsStart{ Clock::now() };
+	uint64_t fpsFrames{ 0 };
+	Clock::time_point titleStart{ fpsStart };
+	uint32_t titleFrames{ 0 };
+	// Present ids are the frame numbers, they start over with every new swapchain
+	uint64_t firstPresentId{ 1 };
+	Clock::time_point lastPresentTime{};
+	std::vector<double> presentIntervals;
+	if (options.latencyReport) {
+		latencyTracker.thread = std::thread(latencyTrackerRun, frameTimeline);
+	}
+	// Set when acquire or present report that the swapchain no longer matches the surface (or on resize), it's recreated before the next frame
+	bool swapchainOutdated{ false };
+	auto surfaceExtent = [&](const VkSurfaceCapabilitiesKHR& caps) {
+		VkExtent2D extent{ caps.currentExtent };
+		if (extent.width == UINT32_MAX) {
+			extent.width = std::clamp(window->getSize().x, caps.minImageExtent.width, caps.maxImageExtent.width);
+			extent.height = std::clamp(window->getSize().y, caps.minImageExtent.height, caps.maxImageExtent.height);
+		}
+		return extent;
+	};
+	// Some compositors report suboptimal for things a new swapchain can't fix, so it's only recreated if the extent or transform has changed
+	auto swapchainMatchesSurface = [&]() {
+		VkSurfaceCapabilitiesKHR surfaceCaps{};
+		chk(vkGetPhysicalDeviceSurfaceCapabilitiesKHR(physicalDevice, surface, &surfaceCaps));
+		const VkExtent2D extent{ surfaceExtent(surfaceCaps) };
+		return (extent.width == swapchainCI.imageExtent.width) && (extent.height == swapchainCI.imageExtent.height) && (surfaceCaps.currentTransform == swapchainCI.preTransform);
+	};
+	auto recreateSwapchain = [&]() {
+		VkSurfaceCapabilitiesKHR surfaceCaps{};
+		chk(vkGetPhysicalDeviceSurfaceCapabilitiesKHR(physicalDevice, surface, &surfaceCaps));
+		const VkExtent2D extent{ surfaceExtent(surfaceCaps) };
+		// Minimized, nothing can be presented until the surface has a size again
+		if ((extent.width == 0) || (extent.height == 0)) {
+			return false;
+		}
+		firstPresentId = frameTimelineValue + 1;
+		lastPresentTime = {};
+		swapchainCI.preTransform = surfaceCaps.currentTransform;
+		createSwapchain(swapchainCI, renderImageCI, extent);
+		swapchainOutdated = false;
+		return true;
+	};
+	// Matrices and uniform ring offsets of all objects, rewritten every frame
+	const uint32_t gridSize{ (uint32_t)std::ceil(std::sqrt((float)options.objectCount)) };
+	std::vector<glm::mat4> mvps(options.objectCount);
+	std::vector<VkDeviceSize> objectOffsets(options.objectCount);
+	const bool gpuTimestamps{ gpuTimer.queryPool != VK_NULL_HANDLE };
+	// Headless runs end after a fixed number of frames, the other modes that stop early close the window and set this too
+	uint64_t lastFrame{ UINT64_MAX };
+	if (options.headless) {
+		uint64_t measuredFrames{ 0 };
+		if (options.benchmarkFrames > 0) {
+			measuredFrames = std::max<uint64_t>(measuredFrames, benchmarkWarmupFrames + options.benchmarkFrames);
+		}
+		if (options.latencyReport) {
+			measuredFrames = std::max<uint64_t>(measuredFrames, latencyWarmupFrames + options.latencyFrames);
+		}
+		lastFrame = (options.headlessFrames > 0) ? options.headlessFrames : std::max<uint64_t>(300, measuredFrames);
+		if (lastFrame < measuredFrames) {
+			std::cerr << "Headless run ends after " << lastFrame << " frames, the requested measurements need " << measuredFrames << " (including warmup)\n";
+		}
+	}
+	auto stopRendering = [&]() {
+		if (window) {
+			window->close();
+		}
+		lastFrame = frameTimelineValue;
+	};
+	while ((frameTimelineValue < lastFrame) && (!window || window->isOpen())) {
 		sf::Time elapsed = clock.restart();
+		const Clock::time_point frameStart{ Clock::now() };
+		frameBenchmark.currentFrame = {};
+		if (swapchainOutdated && !recreateSwapchain()) {
+			while (const std::optional event = window->pollEvent()) {
+				if (event->is<sf::Event::Closed>()) {
+					window->close();
+				}
+			}
+			std::this_thread::sleep_for(std::chrono::milliseconds(10));
+			continue;
+		}
 		// Sync
-		vkWaitForFences(device, 1, &fences[frameIndex], true, UINT64_MAX);
-		vkResetFences(device, 1, &fences[frameIndex]);
-		vkAcquireNextImageKHR(device, swapchain, UINT64_MAX, presentSemaphores[frameIndex], VK_NULL_HANDLE, &imageIndex);
+		phaseStart = Clock::now();
+		frameTimelineValue++;
+		frameIndex = (frameTimelineValue - 1) % maxFramesInFlight;
+		if (frameTimelineValue > maxFramesInFlight) {
+			const uint64_t waitValue{ frameTimelineValue - maxFramesInFlight };
+			VkSemaphoreWaitInfo waitInfo{ .sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO, .semaphoreCount = 1, .pSemaphores = &frameTimeline, .pValues = &waitValue };
+			chk(vkWaitSemaphores(device, &waitInfo, UINT64_MAX));
+		}
+		if (gpuTimestamps) {
+			gpuTimerCollect(frameIndex);
+		}
+		if (options.drawStats) {
+			drawStatsCollect(frameIndex);
+		}
+		// Frame pacing, waiting until the previous frame is on screen keeps just one frame queued for presentation, so input for this one is sampled as late as possible
+		if (presentWait && (frameTimelineValue > firstPresentId)) {
+			// The timeout keeps the loop going if presentation stalls, e.g. while the window is minimized
+			if (vkWaitForPresentKHR(device, swapchain, frameTimelineValue - 1, 100'000'000) == VK_SUCCESS) {
+				const Clock::time_point presentTime{ Clock::now() };
+				if (lastPresentTime != Clock::time_point{}) {
+					presentIntervals.push_back(msBetween(lastPresentTime, presentTime));
+				}
+				lastPresentTime = presentTime;
+			} else {
+				lastPresentTime = {};
+			}
+		}
+		benchmarkPhase(BenchmarkWait, phaseStart);
+		phaseStart = Clock::now();
+		if (options.headless) {
+			// Offscreen images are per frame in flight, so the timeline wait above has already made this one available
+			imageIndex = frameIndex;
+		} else {
+			const VkResult acquireResult{ vkAcquireNextImageKHR(device, swapchain, UINT64_MAX, presentSemaphores[frameIndex], VK_NULL_HANDLE, &imageIndex) };
+			if (acquireResult == VK_ERROR_OUT_OF_DATE_KHR) {
+				// There's no image to render to, but the frame's timeline value still needs to be signaled
+				VkTimelineSemaphoreSubmitInfo skipTimelineSI{ .sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO, .signalSemaphoreValueCount = 1, .pSignalSemaphoreValues = &frameTimelineValue };
+				VkSubmitInfo skipSI{ .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO, .pNext = &skipTimelineSI, .signalSemaphoreCount = 1, .pSignalSemaphores = &frameTimeline };
+				chk(vkQueueSubmit(queue, 1, &skipSI, VK_NULL_HANDLE));
+				swapchainOutdated = true;
+				continue;
+			}
+			// Suboptimal images can still be rendered to and presented
+			if (acquireResult == VK_SUBOPTIMAL_KHR) {
+				swapchainOutdated = swapchainOutdated || !swapchainMatchesSurface();
+			} else {
+				chk(acquireResult);
+			}
+			if (!retiredPresentResources.empty() && presentedImages[imageIndex]) {
+				releaseRetiredPresentResources();
+			}
+		}
+		benchmarkPhase(BenchmarkAcquire, phaseStart);
 		auto cb = commandBuffers[frameIndex];
-		// Update UBO
-		glm::quat rotQ = glm::quat(rotation);
-		const glm::mat4 modelmat = glm::translate(glm::mat4(1.0f), { 0.0f, 0.0f, -2.0f }) * glm::mat4_cast(rotQ);
-		const glm::mat4 mvp = glm::perspective(glm::radians(75.0f), (float)window.getSize().x / (float)window.getSize().y, 0.1f, 32.0f) * modelmat;
-		memcpy(uniformBuffers[frameIndex].mapped, &mvp, sizeof(glm::mat4));
+		// Texture streaming, the upload is started as soon as the file has been read and used once the GPU has finished it
+		retireUploads();
+		if (textureTask.valid() && (textureTask.wait_for(std::chrono::seconds(0)) == std::future_status::ready)) {
+			TextureFile ktxFile{ textureTask.get() };
+			startTextureUpload(ktxFile);
+		}
+		uint64_t completedFrameValue{ 0 };
+		chk(vkGetSemaphoreCounterValue(device, frameTimeline, &completedFrameValue));
+		processDeletionQueue(completedFrameValue);
+		bool textureAcquire{ false };
+		if (!texture.ready && (texture.uploadValue > 0)) {
+			uint64_t uploadValue{ 0 };
+			chk(vkGetSemaphoreCounterValue(device, uploadTimeline, &uploadValue));
+			if (uploadValue >= texture.uploadValue) {
+				texture.ready = true;
+				textureAcquire = true;
+				// The placeholder was last sampled by the previous frame
+				deferFreeDescriptorSet(descriptorPool, placeholderTexture.descriptorSet);
+				deferDestroySampler(placeholderTexture.sampler);
+				deferDestroyImageView(placeholderTexture.view);
+				deferDestroyImage(placeholderTexture.image, placeholderTexture.allocation);
+				placeholderTexture = {};
+				recordStartupPhase("texture_ready", processStart);
+			}
+		}
+		if (!options.pushConstants) {
+			uniformRingBeginFrame(frameIndex);
+			for (auto& offset : objectOffsets) {
+				offset = uniformRingAlloc(sizeof(glm::mat4));
+			}
+		}
+		// Input is sampled right before the matrices that depend on it are written, with --late-latch that's done right before submission
+		auto sampleInputAndUpdateUniforms = [&]() {
+			Clock::time_point sampleStart{ Clock::now() };
+			if (window) {
+				while (const std::optional event = window->pollEvent())
+				{
+					if (event->is<sf::Event::Closed>()) {
+						window->close();
+					}
+					if (const auto* mouseMoved = event->getIf<sf::Event::MouseMoved>()) {
+						if (sf::Mouse::isButtonPressed(sf::Mouse::Button::Left)) {
+							auto delta = lastMousePos - mouseMoved->position;
+							rotation.x += (float)delta.y * 0.0005f * (float)elapsed.asMilliseconds();
+							rotation.y -= (float)delta.x * 0.0005f * (float)elapsed.asMilliseconds();
+						}
+						lastMousePos = mouseMoved->position;
+					}
+					if (event->is<sf::Event::Resized>()) {
+						swapchainOutdated = true;
+					}
+				}
+			}
+			inputTime = Clock::now();
+			benchmarkPhase(BenchmarkEvents, sampleStart);
+			sampleStart = Clock::now();
+			// Update UBO
+			glm::quat rotQ = glm::quat(rotation);
+			const glm::mat4 projection = glm::perspective(glm::radians(75.0f), (float)swapchainCI.imageExtent.width / (float)swapchainCI.imageExtent.height, 0.1f, 32.0f);
+			for (uint32_t i = 0; i < options.objectCount; i++) {
+				// Objects are laid out on a square grid that shrinks with their count, a single object covers the view as before
+				const glm::vec2 gridPos{ (float)(i % gridSize) - (float)(gridSize - 1) * 0.5f, (float)(i / gridSize) - (float)(gridSize - 1) * 0.5f };
+				const glm::mat4 modelmat = glm::translate(glm::mat4(1.0f), { gridPos * 2.0f / (float)gridSize, -2.0f }) * glm::scale(glm::mat4(1.0f), glm::vec3(1.0f / (float)gridSize)) * glm::mat4_cast(rotQ);
+				mvps[i] = projection * modelmat;
+				if (!options.pushConstants) {
+					memcpy(uniformRing.mapped + objectOffsets[i], &mvps[i], sizeof(glm::mat4));
+				}
+			}
+			if (!options.pushConstants) {
+				uniformRingFlush();
+			}
+			benchmarkPhase(BenchmarkUniforms, sampleStart);
+		};
+		if (!options.lateLatch) {
+			sampleInputAndUpdateUniforms();
+		}
 		// Build CB
+		phaseStart = Clock::now();
+		// Late latching with push constants samples input while recording, which is counted in its own phases
+		const double sampledBeforeRecordMs{ frameBenchmark.currentFrame[BenchmarkEvents] + frameBenchmark.currentFrame[BenchmarkUniforms] };
 		VkCommandBufferBeginInfo cbBI { .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO, .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT, };
 		vkResetCommandBuffer(cb, 0);
 		vkBeginCommandBuffer(cb, &cbBI);
+		if (gpuTimestamps) {
+			vkCmdResetQueryPool(cb, gpuTimer.queryPool, frameIndex * gpuTimestampsPerFrame, gpuTimestampsPerFrame);
+			gpuTimerWrite(cb, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, 0);
+		}
+		// Queries can only be reset outside of rendering
+		if (options.drawStats) {
+			vkCmdResetQueryPool(cb, drawStats.statisticsPool, frameIndex, 1);
+			vkCmdResetQueryPool(cb, drawStats.occlusionPool, frameIndex, 1);
+		}
+		if (textureAcquire) {
+			if (texture.recordAcquire) {
+				texture.recordAcquire(cb);
+			}
+			// With a dedicated transfer queue the mip generation objects are only created by recordAcquire, either way this frame is the last to use them
+			if (texture.cleanup) {
+				deferDeletion(std::move(texture.cleanup));
+				texture.cleanup = nullptr;
+			}
+		}
 		VkImageMemoryBarrier barrier0{
 			.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
 			.srcAccessMask = 0,
@@ -398,6 +2317,9 @@ int main()
 			.subresourceRange{.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT, .levelCount = 1, .layerCount = 1 }
 		};
 		vkCmdPipelineBarrier(cb, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier0);
+		if (gpuTimestamps) {
+			gpuTimerWrite(cb, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 1);
+		}
 		VkRenderingAttachmentInfo colorAttachmentInfo{
 			.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO,
 			.imageView = renderImageView,
@@ -411,121 +2333,285 @@ int main()
 		};
 		VkRenderingInfo renderingInfo{
 			.sType = VK_STRUCTURE_TYPE_RENDERING_INFO,
-			.renderArea{.extent{.width = window.getSize().x, .height = window.getSize().y }},
+			.renderArea{.extent = swapchainCI.imageExtent },
 			.layerCount = 1,
 			.colorAttachmentCount = 1,
 			.pColorAttachments = &colorAttachmentInfo,
 		};
 		vkCmdBeginRendering(cb, &renderingInfo);
-		VkViewport vp{ .width = static_cast<float>(window.getSize().x), .height = static_cast<float>(window.getSize().y), .minDepth = 0.0f, .maxDepth = 1.0f};
+		VkViewport vp{ .width = static_cast<float>(swapchainCI.imageExtent.width), .height = static_cast<float>(swapchainCI.imageExtent.height), .minDepth = 0.0f, .maxDepth = 1.0f};
 		vkCmdSetViewport(cb, 0, 1, &vp);
-		VkRect2D scissor{ .extent{ .width = window.getSize().x, .height = window.getSize().y } };
+		VkRect2D scissor{ .extent = swapchainCI.imageExtent };
 		vkCmdSetScissor(cb, 0, 1, &scissor);
-		vkCmdBindDescriptorSets(cb, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &uniformBuffers[frameIndex].descriptorSet, 0, nullptr);
-		vkCmdBindDescriptorSets(cb, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 1, 1, &texture.descriptorSet, 0, nullptr);
+		vkCmdBindDescriptorSets(cb, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 1, 1, texture.ready ? &texture.descriptorSet : &placeholderTexture.descriptorSet, 0, nullptr);
 		vkCmdBindPipeline(cb, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
 		VkDeviceSize vOffset{ 0 };
 		vkCmdBindVertexBuffers(cb, 0, 1, &vBuffer, &vOffset);
 		vkCmdBindIndexBuffer(cb, vBuffer, vBufSize, VK_INDEX_TYPE_UINT16);
-		vkCmdDrawIndexed(cb, 6, 1, 0, 0, 0);
+		// Push constants are part of the command buffer, so late latching can only move sampling up to here
+		if (options.pushConstants && options.lateLatch) {
+			sampleInputAndUpdateUniforms();
+		}
+		if (options.drawStats) {
+			vkCmdBeginQuery(cb, drawStats.statisticsPool, frameIndex, 0);
+			vkCmdBeginQuery(cb, drawStats.occlusionPool, frameIndex, drawStats.occlusionFlags);
+		}
+		for (uint32_t i = 0; i < options.objectCount; i++) {
+			if (options.pushConstants) {
+				vkCmdPushConstants(cb, pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(glm::mat4), &mvps[i]);
+			} else {
+				const uint32_t dynamicOffset{ (uint32_t)objectOffsets[i] };
+				vkCmdBindDescriptorSets(cb, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &uniformRing.descriptorSet, 1, &dynamicOffset);
+			}
+			vkCmdDrawIndexed(cb, 6, 1, 0, 0, 0);
+		}
+		if (options.drawStats) {
+			vkCmdEndQuery(cb, drawStats.occlusionPool, frameIndex);
+			vkCmdEndQuery(cb, drawStats.statisticsPool, frameIndex);
+			drawStats.pendingPixels[frameIndex] = (uint64_t)swapchainCI.imageExtent.width * swapchainCI.imageExtent.height;
+		}
+		// The MSAA resolve happens when rendering ends, so timestamps on both sides of that separate it from the draws
+		if (gpuTimestamps) {
+			gpuTimerWrite(cb, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 2);
+		}
 		vkCmdEndRendering(cb);
+		if (gpuTimestamps) {
+			gpuTimerWrite(cb, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 3);
+		}
 		VkImageMemoryBarrier barrier1{
 			.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
 			.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
 			.dstAccessMask = 0,
 			.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED,
-			.newLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
+			.newLayout = options.headless ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
 			.image = swapchainImages[imageIndex],
 			.subresourceRange{.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT, .levelCount = 1, .layerCount = 1 }
 		};
 		vkCmdPipelineBarrier(cb, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier1);
+		if (gpuTimestamps) {
+			gpuTimerWrite(cb, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 4);
+		}
 		vkEndCommandBuffer(cb);
+		if (gpuTimestamps) {
+			gpuTimer.pending[frameIndex] = { .value = frameTimelineValue, .recordTime = Clock::now() };
+		}
+		benchmarkPhase(BenchmarkRecord, phaseStart);
+		frameBenchmark.currentFrame[BenchmarkRecord] -= frameBenchmark.currentFrame[BenchmarkEvents] + frameBenchmark.currentFrame[BenchmarkUniforms] - sampledBeforeRecordMs;
+		if (options.lateLatch && !options.pushConstants) {
+			sampleInputAndUpdateUniforms();
+		}
+		if (options.latencyReport && (frameTimelineValue > latencyWarmupFrames)) {
+			std::lock_guard<std::mutex> lock(latencyTracker.mutex);
+			latencyTracker.pending.push_back({ .value = frameTimelineValue, .inputTime = inputTime });
+			latencyTracker.frameTimes.push_back(elapsed.asMicroseconds() / 1000.0);
+		}
 		// Submit
-		VkPipelineStageFlags waitStages = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+		// Also waits for the uploads this frame reads from
+		const VkSemaphore waitSemaphores[2]{ presentSemaphores[frameIndex], uploadTimeline };
+		const VkPipelineStageFlags waitStages[2]{ VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT };
+		const uint64_t waitValues[2]{ 0, texture.ready ? texture.uploadValue : geometryUploadValue };
+		const VkSemaphore signalSemaphores[2]{ options.headless ? VK_NULL_HANDLE : renderSemaphores[imageIndex], frameTimeline };
+		const uint64_t signalValues[2]{ 0, frameTimelineValue };
+		// Headless frames neither acquire nor present, so they skip the binary semaphores at the front of both lists
+		const uint32_t wsiSemaphoreOffset{ options.headless ? 1u : 0u };
+		VkTimelineSemaphoreSubmitInfo timelineSI{ .sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO, .waitSemaphoreValueCount = 2 - wsiSemaphoreOffset, .pWaitSemaphoreValues = waitValues + wsiSemaphoreOffset, .signalSemaphoreValueCount = 2 - wsiSemaphoreOffset, .pSignalSemaphoreValues = signalValues + wsiSemaphoreOffset };
 		VkSubmitInfo submitInfo{
 			.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
-			.waitSemaphoreCount = 1,
-			.pWaitSemaphores = &presentSemaphores[frameIndex],
-			.pWaitDstStageMask = &waitStages,
+			.pNext = &timelineSI,
+			.waitSemaphoreCount = 2 - wsiSemaphoreOffset,
+			.pWaitSemaphores = waitSemaphores + wsiSemaphoreOffset,
+			.pWaitDstStageMask = waitStages + wsiSemaphoreOffset,
 			.commandBufferCount = 1,
 			.pCommandBuffers = &cb,
-			.signalSemaphoreCount = 1,
-			.pSignalSemaphores = &renderSemaphores[imageIndex],
-		};
-		vkQueueSubmit(queue, 1, &submitInfo, fences[frameIndex]);
-		VkPresentInfoKHR presentInfo{
-			.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR,
-			.waitSemaphoreCount = 1,
-			.pWaitSemaphores = &renderSemaphores[imageIndex],
-			.swapchainCount = 1,
-			.pSwapchains = &swapchain,
-			.pImageIndices = &imageIndex
+			.signalSemaphoreCount = 2 - wsiSemaphoreOffset,
+			.pSignalSemaphores = signalSemaphores + wsiSemaphoreOffset,
 		};
-		chk(vkQueuePresentKHR(queue, &presentInfo));
-		frameIndex++;
-		if (frameIndex >= maxFramesInFlight) { frameIndex = 0; }
-		while (const std::optional event = window.pollEvent())
-		{
-			if (event->is<sf::Event::Closed>()) {
-				window.close();
-			}
-			if (const auto* mouseMoved = event->getIf<sf::Event::MouseMoved>()) {
-				if (sf::Mouse::isButtonPressed(sf::Mouse::Button::Left)) {
-					auto delta = lastMousePos - mouseMoved->position;
-					rotation.x += (float)delta.y * 0.0005f * (float)elapsed.asMilliseconds();
-					rotation.y -= (float)delta.x * 0.0005f * (float)elapsed.asMilliseconds();
-				}
-				lastMousePos = mouseMoved->position;
-			}
-			if (event->is<sf::Event::Resized>()) {
-				vkDeviceWaitIdle(device);
-				swapchainCI.oldSwapchain = swapchain;
-				swapchainCI.imageExtent = { .width = static_cast<uint32_t>(window.getSize().x), .height = static_cast<uint32_t>(window.getSize().y) };
-				chk(vkCreateSwapchainKHR(device, &swapchainCI, nullptr, &swapchain));
-				auto oldImageCount = imageCount;
-				vkGetSwapchainImagesKHR(device, swapchain, &imageCount, nullptr);
-				swapchainImages.resize(imageCount);
-				vkGetSwapchainImagesKHR(device, swapchain, &imageCount, swapchainImages.data());
-				vmaDestroyImage(allocator, renderImage, renderImageAllocation);
-				vkDestroyImageView(device, renderImageView, nullptr);
-				for (auto i = 0; i < swapchainImageViews.size(); i++) {
-					vkDestroyImageView(device, swapchainImageViews[i], nullptr);
-				}
-				swapchainImageViews.resize(imageCount);
-				renderImageCI.extent = { .width = static_cast<uint32_t>(window.getSize().x), .height = static_cast<uint32_t>(window.getSize().y), .depth = 1 };
-				VmaAllocationCreateInfo allocCI{ .flags = VMA_ALLOCATION_CREATE_DEDICATED_MEMORY_BIT, .usage = VMA_MEMORY_USAGE_AUTO, .priority = 1.0f };
-				chk(vmaCreateImage(allocator, &renderImageCI, &allocCI, &renderImage, &renderImageAllocation, nullptr));
-				VkImageViewCreateInfo viewCI{ .sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO, .image = renderImage, .viewType = VK_IMAGE_VIEW_TYPE_2D, .format = imageFormat, .subresourceRange = {.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT, .levelCount = 1, .layerCount = 1 } };
-				chk(vkCreateImageView(device, &viewCI, nullptr, &renderImageView));
-				for (auto i = 0; i < imageCount; i++) {
-					viewCI.image = swapchainImages[i];
-					chk(vkCreateImageView(device, &viewCI, nullptr, &swapchainImageViews[i]));
+		phaseStart = Clock::now();
+		chk(vkQueueSubmit(queue, 1, &submitInfo, VK_NULL_HANDLE));
+		benchmarkPhase(BenchmarkSubmit, phaseStart);
+		phaseStart = Clock::now();
+		if (!options.headless) {
+			const uint64_t presentId{ frameTimelineValue };
+			VkPresentIdKHR presentIdInfo{ .sType = VK_STRUCTURE_TYPE_PRESENT_ID_KHR, .swapchainCount = 1, .pPresentIds = &presentId };
+			VkPresentInfoKHR presentInfo{
+				.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR,
+				.pNext = presentWait ? &presentIdInfo : nullptr,
+				.waitSemaphoreCount = 1,
+				.pWaitSemaphores = &renderSemaphores[imageIndex],
+				.swapchainCount = 1,
+				.pSwapchains = &swapchain,
+				.pImageIndices = &imageIndex
+			};
+			const VkResult presentResult{ vkQueuePresentKHR(queue, &presentInfo) };
+			if (presentResult == VK_ERROR_OUT_OF_DATE_KHR) {
+				swapchainOutdated = true;
+			} else if (presentResult == VK_SUBOPTIMAL_KHR) {
+				swapchainOutdated = swapchainOutdated || !swapchainMatchesSurface();
+			} else {
+				chk(presentResult);
+			}
+			if (presentResult != VK_ERROR_OUT_OF_DATE_KHR) {
+				presentedImages[imageIndex] = true;
+			}
+		}
+		benchmarkPhase(BenchmarkPresent, phaseStart);
+		if (firstFrame) {
+			recordStartupPhase("time_to_first_frame", processStart);
+			firstFrame = false;
+		}
+		// The texture streams in after the first frame, so startup is only reported once it's ready and all of its phases have been recorded
+		if (!startupReported && texture.ready) {
+			std::vector<StartupPhase> phases;
+			{
+				std::lock_guard<std::mutex> lock(startupPhasesMutex);
+				phases = startupPhases;
+			}
+			if (!options.startupRunFile.empty()) {
+				std::ofstream file(options.startupRunFile);
+				for (const auto& phase : phases) {
+					file << phase.name << " " << phase.mainThread << " " << phase.startMs << " " << phase.durationMs << "\n";
 				}
-				vkDestroySwapchainKHR(device, swapchainCI.oldSwapchain, nullptr);
+				stopRendering();
+			} else if (options.startupReport) {
+				writeStartupReport({ phases });
+			}
+			startupReported = true;
+		}
+		fpsFrames++;
+		titleFrames++;
+		if (const double titleMs{ msBetween(titleStart, Clock::now()) }; titleMs >= 1000.0) {
+			std::string title{ std::format("Modern Vulkan Triangle - {} - {:.1f} fps", presentModeName(presentMode), titleFrames * 1000.0 / titleMs) };
+			if (options.drawStats && !drawStats.frames[DrawStatFragmentsPerPixel].empty()) {
+				title += std::format(" - {:.2f} fragments/pixel", drawStats.frames[DrawStatFragmentsPerPixel].back());
+			}
+			if (options.gpuTimes) {
+				title += std::format(" - GPU {:.2f} ms", computeStats(std::vector<double>(gpuTimer.passTimes[GpuPassFrame].begin(), gpuTimer.passTimes[GpuPassFrame].end())).mean);
 			}
+			if (window) {
+				window->setTitle(title);
+			}
+			titleStart = Clock::now();
+			titleFrames = 0;
+		}
+		if (options.latencyReport && (latencyTracker.frameTimes.size() >= options.latencyFrames)) {
+			stopRendering();
+		}
+		if ((options.benchmarkFrames > 0) && (frameTimelineValue > benchmarkWarmupFrames)) {
+			for (uint32_t i = 0; i < BenchmarkPhaseCount; i++) {
+				frameBenchmark.phaseTimes[i].push_back(frameBenchmark.currentFrame[i]);
+			}
+			frameBenchmark.frameTimes.push_back(msBetween(frameStart, Clock::now()));
+			if (frameBenchmark.frameTimes.size() >= options.benchmarkFrames) {
+				stopRendering();
+			}
+		}
+		if (!options.traceFile.empty()) {
+			traceAdd(std::format("frame {}", frameTimelineValue), "frame", frameStart, Clock::now());
 		}
 	}
 	// Tear down
 	vkDeviceWaitIdle(device);
-	for (auto i = 0; i < maxFramesInFlight; i++) {
-		vkDestroyFence(device, fences[i], nullptr);
-		vkDestroySemaphore(device, presentSemaphores[i], nullptr);
-		vkDestroySemaphore(device, renderSemaphores[i], nullptr);
-		vmaUnmapMemory(allocator, uniformBuffers[i].allocation);
-		vmaDestroyBuffer(allocator, uniformBuffers[i].buffer, uniformBuffers[i].allocation);
+	// Everything has finished, so the timestamps of the last frames can be read too
+	for (uint32_t i = 0; gpuTimestamps && (i < maxFramesInFlight); i++) {
+		gpuTimerCollect(i);
+	}
+	if (!options.traceFile.empty()) {
+		writeTrace(options.traceFile);
 	}
+	if (options.fpsReport) {
+		const double seconds{ msBetween(fpsStart, Clock::now()) / 1000.0 };
+		std::ofstream file;
+		if (!options.fpsReportFile.empty()) {
+			file.open(options.fpsReportFile);
+		}
+		std::ostream& out{ file.is_open() ? file : std::cout };
+		out << "{ \"present_mode\": \"" << (options.headless ? "none" : presentModeName(presentMode)) << "\", \"image_count\": " << swapchainImages.size() << ", \"frames\": " << fpsFrames << ", \"seconds\": " << seconds << ", \"fps\": " << (seconds > 0.0 ? fpsFrames / seconds : 0.0);
+		if (presentWait) {
+			out << ", \"present_interval_ms\": ";
+			writeStatsJson(out, computeStats(presentIntervals));
+		}
+		out << " }\n";
+	}
+	if (options.gpuTimes) {
+		std::ofstream file;
+		if (!options.gpuTimesFile.empty()) {
+			file.open(options.gpuTimesFile);
+		}
+		std::ostream& out{ file.is_open() ? file : std::cout };
+		writeGpuTimesJson(out);
+		out << "\n";
+	}
+	if (options.drawStats) {
+		std::ofstream file;
+		if (!options.drawStatsFile.empty()) {
+			file.open(options.drawStatsFile);
+		}
+		std::ostream& out{ file.is_open() ? file : std::cout };
+		writeDrawStatsJson(out, swapchainCI.imageExtent);
+		out << "\n";
+	}
+	if (options.benchmarkFrames > 0) {
+		writeBenchmarkJson(std::cout);
+		std::cout << "\n";
+	}
+	if (latencyTracker.thread.joinable()) {
+		latencyTracker.stop = true;
+		latencyTracker.thread.join();
+		std::ofstream file;
+		if (!options.latencyRunFile.empty()) {
+			file.open(options.latencyRunFile);
+		} else if (!options.latencyReportFile.empty()) {
+			file.open(options.latencyReportFile);
+		}
+		std::ostream& out{ file.is_open() ? file : std::cout };
+		writeLatencyJson(out);
+		out << "\n";
+	}
+	for (auto semaphore : presentSemaphores) {
+		vkDestroySemaphore(device, semaphore, nullptr);
+	}
+	vmaDestroyBuffer(allocator, uniformRing.buffer, uniformRing.allocation);
+	releaseRetiredPresentResources();
+	processDeletionQueue(UINT64_MAX);
+	for (auto semaphore : renderSemaphores) {
+		vkDestroySemaphore(device, semaphore, nullptr);
+	}
+	vkDestroySemaphore(device, frameTimeline, nullptr);
+	vkDestroyQueryPool(device, gpuTimer.queryPool, nullptr);
+	vkDestroyQueryPool(device, drawStats.statisticsPool, nullptr);
+	vkDestroyQueryPool(device, drawStats.occlusionPool, nullptr);
 	vmaDestroyImage(allocator, renderImage, renderImageAllocation);
 	vkDestroyImageView(device, renderImageView, nullptr);
 	for (auto i = 0; i < swapchainImageViews.size(); i++) {
 		vkDestroyImageView(device, swapchainImageViews[i], nullptr);
 	}
+	for (auto i = 0; i < offscreenImageAllocations.size(); i++) {
+		vmaDestroyImage(allocator, swapchainImages[i], offscreenImageAllocations[i]);
+	}
 	vmaDestroyBuffer(allocator, vBuffer, vBufferAllocation);
-	vmaDestroyImage(allocator, texture.image, texture.allocation);
+	stagingRingRecycle(false);
+	vmaDestroyBuffer(allocator, stagingRing.buffer, stagingRing.allocation);
+	vkDestroySemaphore(device, uploadTimeline, nullptr);
+	// Only still set if the window was closed before the texture finished streaming in
+	if (texture.cleanup) {
+		texture.cleanup();
+	}
+	for (auto& tex : { texture, placeholderTexture }) {
+		vkDestroySampler(device, tex.sampler, nullptr);
+		vkDestroyImageView(device, tex.view, nullptr);
+		vmaDestroyImage(allocator, tex.image, tex.allocation);
+	}
+	vkDestroyCommandPool(device, uploadCommandPool, nullptr);
 	vkDestroyCommandPool(device, commandPool, nullptr);
 	vkDestroyPipelineLayout(device, pipelineLayout, nullptr);
 	vkDestroyPipeline(device, pipeline, nullptr);
-	vkDestroySwapchainKHR(device, swapchain, nullptr);
-	vkDestroySurfaceKHR(instance, surface, nullptr);
+	savePipelineCacheData();
+	vkDestroyPipelineCache(device, pipelineCache, nullptr);
+	// The WSI functions aren't available without their extensions
+	if (!options.headless) {
+		vkDestroySwapchainKHR(device, swapchain, nullptr);
+		vkDestroySurfaceKHR(instance, surface, nullptr);
+	}
 	vmaDestroyAllocator(allocator);
 	vkDestroyDevice(device, nullptr);
 	vkDestroyInstance(instance, nullptr);